@@ -1,8 +1,43 @@
+#ifdef CLOCK_REMOTE_SERVICES
+// before Windows.h, which would otherwise bring in the old winsock.h
+#include<winsock2.h>
+#include<afunix.h>
+#endif
 #include"app.h"
 #include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<climits>
+#include<condition_variable>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<deque>
+#include<exception>
+#include<iomanip>
 #include<iterator>
 #include<iostream>
+#include<list>
+#include<mutex>
 #include<regex>
+#include<thread>
+#include<unordered_set>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CLOCK_X86
+#include<immintrin.h>
+#ifdef _MSC_VER
+#include<intrin.h>
+#define CLOCK_TARGET(x)
+#else
+#include<cpuid.h>
+#define CLOCK_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+#if defined(CLOCK_REMOTE_SERVICES) && defined(_MSC_VER)
+#pragma comment(lib, "Ws2_32.lib")
+#endif
 
 using namespace std;
 
@@ -17,192 +52,3543 @@ namespace service_system
 
 		}
 
+		using abstraction::data::exception::ErrorCode;
+		using abstraction::data::exception::Status;
+
+		// formats the message of a failed call, the try* paths never get here
+		static void raise(const Status& status, const string& eventName, const string& observerName)
+		{
+			switch (status.code())
+			{
+			case ErrorCode::NONE:
+				return;
+			case ErrorCode::OBSERVER_ALREADY_REGISTERED:
+			case ErrorCode::OBSERVER_NOT_FOUND:
+				throw abstraction::data::exception::Exception(status.message(observerName));
+			default:
+				throw abstraction::data::exception::Exception(status.message(eventName));
+			}
+		}
+
+		static void raise(const Status& status, Publisher::EventHandle event, const string& observerName)
+		{
+			if (!status)
+				raise(status, std::to_string(static_cast<size_t>(event)), observerName);
+		}
+
 		class Publisher::PublisherImpl
 		{
-		public:
-			PublisherImpl() = default;
-			~PublisherImpl() = default;
+		public:
+			PublisherImpl(PublishingStrategy st, const publisher_data_abstraction::DispatchQueueOptions& options);
+			~PublisherImpl() = default;
+
+			Status subscribe(EventHandle event, std::unique_ptr<abstraction::boundary::proxy::Observer>&& observer, int priority);
+			// observers are left untouched on failure, rejected is the index of the name already taken
+			Status subscribe(EventHandle event, std::vector<std::unique_ptr<abstraction::boundary::proxy::Observer>>& observers, int priority, size_t& rejected);
+			Status unsubscribe(EventHandle event, const std::string& observerName);
+			Status notify(EventHandle event, std::shared_ptr<abstraction::data::Data>, size_t coalescingKey) const;
+			Status notifyBatch(EventHandle event, const abstraction::data::DataBatch& batch) const;
+
+			Status registerEvent(const string& eventName, EventHandle& event);
+			Status getEventHandle(const string& eventName, EventHandle& event) const;
+			bool hasObservers(EventHandle event) const;
+			publisher_data_abstraction::DispatchStatistics getDispatchStatistics() const;
+			std::vector<publisher_data_abstraction::ObserverStatistics> getObserverStatistics() const;
+			void resetObserverStatistics();
+
+		private:
+			class Dispatcher;
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			class Statistics;
+#endif
+
+			Status dispatch(EventHandle event, const std::shared_ptr<abstraction::data::Data>& data) const;
+			Status dispatchBatch(EventHandle event, const abstraction::data::DataBatch& batch) const;
+
+			// all that notify reads of a subscription
+			struct Target
+			{
+				abstraction::boundary::proxy::Observer* observer;
+				size_t slot;	// index of the (event, observer) pair in m_slots
+			};
+
+			// what only the writers read
+			struct Owner
+			{
+				shared_ptr<abstraction::boundary::proxy::Observer> observer;
+				int priority;
+			};
+
+			// Sorted by decreasing priority, notify is a linear scan over the dense targets.
+			// The capacity is fixed: a snapshot only sees its first count entries, so the writer
+			// may fill the entries past the published count in place, anything else copies the list.
+			struct ObserversList
+			{
+				explicit ObserversList(size_t capacity)
+					: capacity{ capacity }, size{ 0 }, targets{ new Target[capacity] }, owners{ new Owner[capacity] } {}
+
+				const size_t capacity;
+				size_t size;	// entries written so far, guarded by m_writer
+				std::unique_ptr<Target[]> targets;
+				std::unique_ptr<Owner[]> owners;
+			};
+
+			struct Observers
+			{
+				shared_ptr<ObserversList> list;
+				size_t count;
+
+				const Target* begin() const { return list->targets.get(); }
+				const Target* end() const { return list->targets.get() + count; }
+			};
+			using Events = std::unordered_map<string, EventHandle>;
+
+			// immutable once published: writers copy it, modify the copy and publish it
+			struct Snapshot
+			{
+				std::vector<Observers> observers; // indexed by EventHandle
+				shared_ptr<const Events> events;
+			};
+
+			// keeps the snapshot, and its observers, alive while they are notified
+			class Reader
+			{
+			public:
+				explicit Reader(const PublisherImpl& publisher);
+				~Reader();
+
+				const Snapshot& operator*() const { return *m_snapshot; }
+				const Snapshot* operator->() const { return m_snapshot; }
+
+			private:
+				Reader(const Reader&) = delete;
+				Reader& operator=(const Reader&) = delete;
+
+			private:
+				const PublisherImpl& m_publisher;
+				shared_ptr<const Snapshot> m_pinned;	// Concurrent and Asynchronous only
+				const Snapshot* m_snapshot;
+			};
+
+			static bool isRegistered(const Snapshot& s, EventHandle event) { return static_cast<size_t>(event) < s.observers.size(); }
+			void publish(shared_ptr<const Snapshot> s);
+			size_t acquireSlot(EventHandle event, const string& observerName);
+			void releaseSlot(size_t slot) noexcept;
+
+		private:
+			const PublishingStrategy m_strategy;
+
+			// serializes the writers, notify never takes it
+			mutable std::mutex m_writer;
+			shared_ptr<const Snapshot> m_snapshot;
+
+			// Synchronous only: a snapshot replaced during a notify is freed once the outermost one returns
+			mutable size_t m_readers = 0;
+			mutable std::vector<shared_ptr<const Snapshot>> m_retired;
+
+			// the (event, observer name) pair of every subscription, guarded by m_writer;
+			// a slot is reused once its subscription goes away
+			std::vector<std::pair<EventHandle, string>> m_slots;
+			std::vector<size_t> m_freeSlots;	// never reallocates, its capacity follows m_slots
+
+			// names subscribed to each event, indexed by EventHandle and guarded by m_writer
+			std::vector<std::unordered_set<string>> m_names;
+
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			std::unique_ptr<Statistics> m_statistics;
+#endif
+
+			// Asynchronous strategy only, declared last so that its threads are joined first
+			std::unique_ptr<Dispatcher> m_dispatcher;
+		};
+
+		// bounded multi-producer queue drained by the dispatcher threads
+		class Publisher::PublisherImpl::Dispatcher
+		{
+		public:
+			Dispatcher(const PublisherImpl& publisher, const publisher_data_abstraction::DispatchQueueOptions& options);
+			~Dispatcher();
+
+			void post(EventHandle event, std::shared_ptr<abstraction::data::Data> data, size_t key);
+			void post(EventHandle event, std::shared_ptr<const abstraction::data::DataBatch> batch);
+			publisher_data_abstraction::DispatchStatistics getStatistics() const;
+
+		private:
+			struct Entry
+			{
+				uint64_t seq;
+				EventHandle event;
+				size_t key;
+				std::shared_ptr<abstraction::data::Data> data;
+				std::shared_ptr<const abstraction::data::DataBatch> batch;	// set for notifyBatch, never coalesced
+			};
+
+			using Key = std::pair<size_t, size_t>;
+			struct KeyHash
+			{
+				size_t operator()(const Key& k) const { return std::hash<size_t>{}(k.first * 31 + k.second); }
+			};
+
+			void push(Entry e);
+			void run();
+			bool isDispatcherThread() const;
+			void popFront();
+
+		private:
+			const PublisherImpl& m_publisher;
+			const publisher_data_abstraction::DispatchQueueOptions m_options;
+
+			mutable std::mutex m_mutex;
+			std::condition_variable m_notEmpty;
+			std::condition_variable m_notFull;
+			std::deque<Entry> m_queue;
+			std::unordered_map<Key, uint64_t, KeyHash> m_pending;	// CoalesceByKey only
+			uint64_t m_nextSeq;
+			bool m_stopping;
+
+			publisher_data_abstraction::DispatchStatistics m_stats;
+			std::atomic<uint64_t> m_dispatched;
+			std::atomic<uint64_t> m_failed;
+
+			std::vector<std::thread> m_threads;
+		};
+
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+		// Every thread that notifies gets its own counters, so recording is a few relaxed
+		// atomic adds that no other thread contends on. Snapshot and reset sum them up.
+		class Publisher::PublisherImpl::Statistics
+		{
+		public:
+			using clock = std::chrono::steady_clock;
+
+			Statistics() : m_id{ nextId++ } {}
+
+			void record(size_t slot, clock::duration elapsed) const;
+			void collect(std::vector<publisher_data_abstraction::ObserverStatistics>& stats) const;
+			void reset();
+			void reset(size_t slot);
+
+		private:
+			struct Counters
+			{
+				std::atomic<uint64_t> calls;
+				std::atomic<uint64_t> nanoseconds;
+				std::atomic<uint64_t> histogram[publisher_data_abstraction::ObserverStatistics::bucketCount];
+			};
+
+			// counters of one thread, in blocks so that growing never moves them
+			class ThreadCounters
+			{
+			public:
+				static const size_t blockSize = 64;
+
+				Counters& get(size_t slot);
+				template <class F> void forEach(F f);
+				template <class F> void forSlot(size_t slot, F f);
+
+			private:
+				std::mutex m_growth;	// taken to grow and by the readers, never to record
+				std::vector<std::unique_ptr<Counters[]>> m_blocks;
+			};
+
+			ThreadCounters& local() const;
+			static void clear(Counters& c);
+
+		private:
+			static std::atomic<uint64_t> nextId;
+
+			const uint64_t m_id;
+			mutable std::mutex m_mutex;
+			mutable std::unordered_map<std::thread::id, std::unique_ptr<ThreadCounters>> m_threads;
+		};
+
+		// 0 marks an empty entry of the per-thread cache
+		std::atomic<uint64_t> Publisher::PublisherImpl::Statistics::nextId{ 1 };
+
+		Publisher::PublisherImpl::Statistics::Counters& Publisher::PublisherImpl::Statistics::ThreadCounters::get(size_t slot)
+		{
+			const auto block = slot / blockSize;
+			if (block >= m_blocks.size())
+			{
+				std::lock_guard<std::mutex> lock{ m_growth };
+				while (m_blocks.size() <= block)
+				{
+					std::unique_ptr<Counters[]> counters{ new Counters[blockSize] };
+					for (size_t i = 0; i < blockSize; ++i)
+					{
+						counters[i].calls = 0;
+						counters[i].nanoseconds = 0;
+						for (auto& h : counters[i].histogram)
+							h = 0;
+					}
+					m_blocks.push_back(std::move(counters));
+				}
+			}
+			return m_blocks[block][slot % blockSize];
+		}
+
+		template <class F>
+		void Publisher::PublisherImpl::Statistics::ThreadCounters::forEach(F f)
+		{
+			std::lock_guard<std::mutex> lock{ m_growth };
+			for (size_t b = 0; b < m_blocks.size(); ++b)
+				for (size_t i = 0; i < blockSize; ++i)
+					f(b * blockSize + i, m_blocks[b][i]);
+		}
+
+		template <class F>
+		void Publisher::PublisherImpl::Statistics::ThreadCounters::forSlot(size_t slot, F f)
+		{
+			std::lock_guard<std::mutex> lock{ m_growth };
+			if (slot / blockSize < m_blocks.size())
+				f(m_blocks[slot / blockSize][slot % blockSize]);
+		}
+
+		Publisher::PublisherImpl::Statistics::ThreadCounters& Publisher::PublisherImpl::Statistics::local() const
+		{
+			// The publisher owns the counters of every thread, each thread only caches a few of them.
+			// Entries are keyed by id rather than address: ids are never reused, so the entry of a
+			// dead publisher never matches again and is simply overwritten.
+			struct Entry
+			{
+				uint64_t id;
+				ThreadCounters* counters;
+			};
+			static const size_t cacheSize = 8;
+			thread_local Entry cache[cacheSize] = {};
+			thread_local size_t victim = 0;
+
+			for (const auto& e : cache)
+				if (e.id == m_id)
+					return *e.counters;
+
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			auto& c = m_threads[std::this_thread::get_id()];
+			if (!c)
+				c = std::make_unique<ThreadCounters>();
+
+			cache[victim] = Entry{ m_id, c.get() };
+			victim = (victim + 1) % cacheSize;
+			return *c;
+		}
+
+		void Publisher::PublisherImpl::Statistics::record(size_t slot, clock::duration elapsed) const
+		{
+			const auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+			size_t bucket = 0;
+			while (bucket + 1 < publisher_data_abstraction::ObserverStatistics::bucketCount && (ns >> (bucket + 1)) != 0)
+				++bucket;
+
+			// only this thread writes these counters
+			auto& c = local().get(slot);
+			c.calls.store(c.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			c.nanoseconds.store(c.nanoseconds.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+			c.histogram[bucket].store(c.histogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		void Publisher::PublisherImpl::Statistics::collect(std::vector<publisher_data_abstraction::ObserverStatistics>& stats) const
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			for (const auto& t : m_threads)
+				t.second->forEach([&](size_t slot, const Counters& c) {
+					if (slot >= stats.size())
+						return;
+					stats[slot].calls += c.calls.load(std::memory_order_relaxed);
+					stats[slot].totalNanoseconds += c.nanoseconds.load(std::memory_order_relaxed);
+					for (size_t i = 0; i < publisher_data_abstraction::ObserverStatistics::bucketCount; ++i)
+						stats[slot].histogram[i] += c.histogram[i].load(std::memory_order_relaxed);
+				});
+		}
+
+		void Publisher::PublisherImpl::Statistics::clear(Counters& c)
+		{
+			c.calls.store(0, std::memory_order_relaxed);
+			c.nanoseconds.store(0, std::memory_order_relaxed);
+			for (auto& h : c.histogram)
+				h.store(0, std::memory_order_relaxed);
+		}
+
+		void Publisher::PublisherImpl::Statistics::reset()
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			for (const auto& t : m_threads)
+				t.second->forEach([](size_t, Counters& c) { clear(c); });
+		}
+
+		void Publisher::PublisherImpl::Statistics::reset(size_t slot)
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			for (const auto& t : m_threads)
+				t.second->forSlot(slot, [](Counters& c) { clear(c); });
+		}
+#endif
+
+		Publisher::PublisherImpl::Dispatcher::Dispatcher(const PublisherImpl& publisher, const publisher_data_abstraction::DispatchQueueOptions& options)
+			: m_publisher{ publisher },
+			m_options{ options },
+			m_nextSeq{ 0 },
+			m_stopping{ false },
+			m_stats{},
+			m_dispatched{ 0 },
+			m_failed{ 0 }
+		{
+			const auto count = std::max<size_t>(1, m_options.dispatcherThreads);
+			for (size_t i = 0; i < count; ++i)
+				m_threads.emplace_back([this] { run(); });
+		}
+
+		Publisher::PublisherImpl::Dispatcher::~Dispatcher()
+		{
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				m_stopping = true;
+			}
+			m_notEmpty.notify_all();
+			m_notFull.notify_all();
+
+			// the pending notifications are delivered before the threads leave
+			for (auto& t : m_threads)
+				t.join();
+		}
+
+		bool Publisher::PublisherImpl::Dispatcher::isDispatcherThread() const
+		{
+			const auto id = std::this_thread::get_id();
+			return std::any_of(m_threads.cbegin(), m_threads.cend(), [id](const auto& t) {
+				return t.get_id() == id; });
+		}
+
+		void Publisher::PublisherImpl::Dispatcher::popFront()
+		{
+			const auto& front = m_queue.front();
+			if (m_options.policy == publisher_data_abstraction::OverflowPolicy::CoalesceByKey)
+			{
+				auto ptr = m_pending.find(Key{ static_cast<size_t>(front.event), front.key });
+				if (ptr != m_pending.end() && ptr->second == front.seq)
+					m_pending.erase(ptr);
+			}
+			m_queue.pop_front();
+		}
+
+		void Publisher::PublisherImpl::Dispatcher::post(EventHandle event, std::shared_ptr<abstraction::data::Data> data, size_t key)
+		{
+			push(Entry{ 0, event, key, std::move(data), nullptr });
+		}
+
+		void Publisher::PublisherImpl::Dispatcher::post(EventHandle event, std::shared_ptr<const abstraction::data::DataBatch> batch)
+		{
+			push(Entry{ 0, event, 0, nullptr, std::move(batch) });
+		}
+
+		void Publisher::PublisherImpl::Dispatcher::push(Entry e)
+		{
+			using publisher_data_abstraction::OverflowPolicy;
+
+			const auto capacity = std::max<size_t>(1, m_options.capacity);
+			const auto coalescing = m_options.policy == OverflowPolicy::CoalesceByKey && !e.batch;
+			const Key k{ static_cast<size_t>(e.event), e.key };
+
+			std::unique_lock<std::mutex> lock{ m_mutex };
+
+			if (m_queue.size() >= capacity)
+			{
+				switch (m_options.policy)
+				{
+				case OverflowPolicy::Block:
+					// an observer notifying from a dispatcher thread would wait on itself
+					if (!isDispatcherThread())
+						m_notFull.wait(lock, [&] { return m_stopping || m_queue.size() < capacity; });
+					break;
+
+				case OverflowPolicy::CoalesceByKey:
+				{
+					auto ptr = coalescing ? m_pending.find(k) : m_pending.end();
+					if (ptr != m_pending.end())
+					{
+						m_queue[static_cast<size_t>(ptr->second - m_queue.front().seq)].data = std::move(e.data);
+						++m_stats.coalesced;
+						return;
+					}
+				}
+				// no pending notification to replace
+				// fall through
+				case OverflowPolicy::DropOldest:
+					popFront();
+					++m_stats.dropped;
+					break;
+				}
+			}
+
+			if (m_stopping)
+			{
+				++m_stats.dropped;
+				return;
+			}
+
+			e.seq = m_nextSeq++;
+			if (coalescing)
+				m_pending[k] = e.seq;
+			m_queue.push_back(std::move(e));
+
+			++m_stats.enqueued;
+			m_stats.highWater = (std::max)(m_stats.highWater, m_queue.size());
+
+			lock.unlock();
+			m_notEmpty.notify_one();
+		}
+
+		void Publisher::PublisherImpl::Dispatcher::run()
+		{
+			for (;;)
+			{
+				Entry e;
+				{
+					std::unique_lock<std::mutex> lock{ m_mutex };
+					m_notEmpty.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+					if (m_queue.empty())
+						return;
+
+					e = std::move(m_queue.front());
+					popFront();
+				}
+				m_notFull.notify_one();
+
+				try
+				{
+					if (e.batch)
+						m_publisher.dispatchBatch(e.event, *e.batch);
+					else
+						m_publisher.dispatch(e.event, e.data);
+				}
+				catch (...)
+				{
+					// nobody is waiting for the result of an asynchronous notification
+					++m_failed;
+				}
+				++m_dispatched;
+			}
+		}
+
+		publisher_data_abstraction::DispatchStatistics Publisher::PublisherImpl::Dispatcher::getStatistics() const
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+
+			auto stats = m_stats;
+			stats.depth = m_queue.size();
+			stats.dispatched = m_dispatched;
+			stats.failed = m_failed;
+			return stats;
+		}
+
+		Publisher::Publisher(PublishingStrategy st, const publisher_data_abstraction::DispatchQueueOptions& options)
+		{
+			impl = std::make_unique<PublisherImpl>(st, options);
+		}
+		void Publisher::subscribe(const string& eventName, unique_ptr<abstraction::boundary::proxy::Observer> observer, int priority)
+		{
+			EventHandle event;
+			auto status = impl->getEventHandle(eventName, event);
+			if (status)
+				status = impl->subscribe(event, std::move(observer), priority);
+			if (!status)
+				raise(status, eventName, observer->getName());
+		}
+		void Publisher::subscribe(EventHandle event, unique_ptr<abstraction::boundary::proxy::Observer> observer, int priority)
+		{
+			const auto status = impl->subscribe(event, std::move(observer), priority);
+			if (!status)
+				raise(status, event, observer->getName());
+		}
+		void Publisher::subscribeMany(EventHandle event, vector<unique_ptr<abstraction::boundary::proxy::Observer>> observers, int priority)
+		{
+			size_t rejected = 0;
+			const auto status = impl->subscribe(event, observers, priority, rejected);
+			if (!status)
+				raise(status, event, rejected < observers.size() ? observers[rejected]->getName() : "");
+		}
+		void Publisher::unsubscribe(const string& eventName, const string& observerName)
+		{
+			EventHandle event;
+			auto status = impl->getEventHandle(eventName, event);
+			if (status)
+				status = impl->unsubscribe(event, observerName);
+			raise(status, eventName, observerName);
+		}
+		void Publisher::unsubscribe(EventHandle event, const string& observerName)
+		{
+			raise(impl->unsubscribe(event, observerName), event, observerName);
+		}
+		Publisher::~Publisher()
+		{
+			// std::unique_ptr requires a definition of the destructor instead
+			// of using the default because the destructor must appear in a scope
+			// in which the complete definition of the template argument for
+			// std::unique_ptr is known
+		}
+		Status Publisher::trySubscribe(EventHandle event, unique_ptr<abstraction::boundary::proxy::Observer>&& observer, int priority)
+		{
+			return impl->subscribe(event, std::move(observer), priority);
+		}
+		Status Publisher::trySubscribeMany(EventHandle event, vector<unique_ptr<abstraction::boundary::proxy::Observer>>&& observers, int priority)
+		{
+			size_t rejected = 0;
+			return impl->subscribe(event, observers, priority, rejected);
+		}
+		Status Publisher::tryUnsubscribe(EventHandle event, const string& observerName)
+		{
+			return impl->unsubscribe(event, observerName);
+		}
+		Status Publisher::tryNotify(EventHandle event, shared_ptr<abstraction::data::Data> data) const
+		{
+			return impl->notify(event, std::move(data), 0);
+		}
+		Status Publisher::tryRegisterEvent(const string& eventName, EventHandle& event)
+		{
+			return impl->registerEvent(eventName, event);
+		}
+		Status Publisher::tryGetEventHandle(const string& eventName, EventHandle& event) const
+		{
+			return impl->getEventHandle(eventName, event);
+		}
+		void Publisher::notify(const string& eventName, shared_ptr<abstraction::data::Data> data) const
+		{
+			EventHandle event;
+			auto status = impl->getEventHandle(eventName, event);
+			if (status)
+				status = impl->notify(event, std::move(data), 0);
+			raise(status, eventName, "");
+		}
+		void Publisher::notify(EventHandle event, shared_ptr<abstraction::data::Data> data) const
+		{
+			raise(impl->notify(event, std::move(data), 0), event, "");
+		}
+		void Publisher::notify(EventHandle event, shared_ptr<abstraction::data::Data> data, size_t coalescingKey) const
+		{
+			raise(impl->notify(event, std::move(data), coalescingKey), event, "");
+		}
+		void Publisher::notifyBatch(const string& eventName, const abstraction::data::DataBatch& batch) const
+		{
+			EventHandle event;
+			auto status = impl->getEventHandle(eventName, event);
+			if (status)
+				status = impl->notifyBatch(event, batch);
+			raise(status, eventName, "");
+		}
+		void Publisher::notifyBatch(EventHandle event, const abstraction::data::DataBatch& batch) const
+		{
+			raise(impl->notifyBatch(event, batch), event, "");
+		}
+		Publisher::EventHandle Publisher::registerEvent(const string& eventName)
+		{
+			EventHandle event{};
+			raise(impl->registerEvent(eventName, event), eventName, "");
+			return event;
+		}
+		Publisher::EventHandle Publisher::getEventHandle(const string& eventName) const
+		{
+			EventHandle event{};
+			raise(impl->getEventHandle(eventName, event), eventName, "");
+			return event;
+		}
+		std::vector<publisher_data_abstraction::ObserverStatistics> Publisher::getObserverStatistics() const
+		{
+			return impl->getObserverStatistics();
+		}
+		void Publisher::resetObserverStatistics()
+		{
+			impl->resetObserverStatistics();
+		}
+		bool Publisher::hasObservers(EventHandle event) const
+		{
+			return impl->hasObservers(event);
+		}
+		publisher_data_abstraction::DispatchStatistics Publisher::getDispatchStatistics() const
+		{
+			return impl->getDispatchStatistics();
+		}
+
+		Publisher::PublisherImpl::PublisherImpl(PublishingStrategy st, const publisher_data_abstraction::DispatchQueueOptions& options)
+			: m_strategy{ st },
+			m_snapshot{ std::make_shared<Snapshot>(Snapshot{ {}, std::make_shared<Events>() }) }
+		{
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			m_statistics = std::make_unique<Statistics>();
+#endif
+			if (m_strategy == PublishingStrategy::Asynchronous)
+				m_dispatcher = std::make_unique<Dispatcher>(*this, options);
+		}
+
+		Publisher::PublisherImpl::Reader::Reader(const PublisherImpl& publisher)
+			: m_publisher{ publisher }
+		{
+			// a single threaded publisher counts its readers instead of touching the reference count
+			if (publisher.m_strategy != PublishingStrategy::Synchronous)
+			{
+				m_pinned = std::atomic_load(&publisher.m_snapshot);
+				m_snapshot = m_pinned.get();
+			}
+			else
+			{
+				++publisher.m_readers;
+				m_snapshot = publisher.m_snapshot.get();
+			}
+		}
+
+		Publisher::PublisherImpl::Reader::~Reader()
+		{
+			if (!m_pinned && --m_publisher.m_readers == 0 && !m_publisher.m_retired.empty())
+				m_publisher.m_retired.clear();
+		}
+
+		void Publisher::PublisherImpl::publish(shared_ptr<const Snapshot> s)
+		{
+			if (m_strategy != PublishingStrategy::Synchronous)
+				std::atomic_store(&m_snapshot, std::move(s));
+			else
+			{
+				// an observer (un)subscribing from notify must not free the list being walked
+				if (m_readers)
+					m_retired.push_back(std::move(m_snapshot));
+				m_snapshot = std::move(s);
+			}
+		}
+
+		Status Publisher::PublisherImpl::subscribe(EventHandle event, std::unique_ptr<abstraction::boundary::proxy::Observer>&& observer, int priority)
+		{
+			vector<unique_ptr<abstraction::boundary::proxy::Observer>> observers;
+			observers.push_back(std::move(observer));
+
+			size_t rejected = 0;
+			const auto status = subscribe(event, observers, priority, rejected);
+			if (!status)
+				observer = std::move(observers.front());
+			return status;
+		}
+
+		Status Publisher::PublisherImpl::subscribe(EventHandle event, vector<unique_ptr<abstraction::boundary::proxy::Observer>>& observers, int priority, size_t& rejected)
+		{
+			std::lock_guard<std::mutex> lock{ m_writer };
+
+			if (!isRegistered(*m_snapshot, event))
+				return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+
+			const auto index = static_cast<size_t>(event);
+			const auto& current = m_snapshot->observers[index];
+			const auto count = current.count;
+			auto& names = m_names[index];
+
+			// the name index makes the duplicate check constant time, a batch is rolled back as a whole
+			size_t added = 0;
+			vector<size_t> slots;
+			auto rollback = [&] {
+				for (auto slot : slots)
+					releaseSlot(slot);
+				for (size_t i = 0; i < added; ++i)
+					names.erase(observers[i]->getName());
+			};
+
+			try
+			{
+				for (; added < observers.size(); ++added)
+				{
+					if (!names.insert(observers[added]->getName()).second)
+					{
+						rejected = added;
+						rollback();
+						return ErrorCode::OBSERVER_ALREADY_REGISTERED;
+					}
+				}
+
+				slots.reserve(observers.size());
+				for (const auto& o : observers)
+					slots.push_back(acquireSlot(event, o->getName()));
+
+				// after every observer of the same priority, which keeps the order reproducible
+				const auto owners = current.list->owners.get();
+				const auto pos = static_cast<size_t>(std::upper_bound(owners, owners + count, priority, [](int p, const Owner& o) {
+					return p > o.priority; }) - owners);
+
+				// appending in place is what keeps a run of subscribes linear overall
+				auto list = current.list;
+				const bool inPlace = pos == count && list->size == count && list->capacity - count >= observers.size();
+				if (!inPlace)
+					list = std::make_shared<ObserversList>((std::max)(size_t{ 16 }, 2 * (count + observers.size())));
+				auto s = std::make_shared<Snapshot>(*m_snapshot);
+
+				// nothing below throws, the observers are only moved once the batch is certain to go in
+				size_t i = 0;
+				if (!inPlace)
+				{
+					for (; i < pos; ++i)
+					{
+						list->targets[i] = current.list->targets[i];
+						list->owners[i] = current.list->owners[i];
+					}
+				}
+				else
+					i = count;
+				for (size_t b = 0; b < observers.size(); ++b, ++i)
+				{
+					list->targets[i] = Target{ observers[b].get(), slots[b] };
+					list->owners[i] = Owner{ std::move(observers[b]), priority };
+				}
+				if (!inPlace)
+				{
+					for (size_t j = pos; j < count; ++j, ++i)
+					{
+						list->targets[i] = current.list->targets[j];
+						list->owners[i] = current.list->owners[j];
+					}
+				}
+				list->size = i;
+
+				s->observers[index] = Observers{ std::move(list), i };
+				publish(std::move(s));
+			}
+			catch (...)
+			{
+				rollback();
+				throw;
+			}
+			observers.clear();
+			return ErrorCode::NONE;
+		}
+
+		Status Publisher::PublisherImpl::unsubscribe(EventHandle event, const string& observerName)
+		{
+			std::lock_guard<std::mutex> lock{ m_writer };
+
+			if (!isRegistered(*m_snapshot, event))
+				return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+
+			const auto index = static_cast<size_t>(event);
+			const auto& current = m_snapshot->observers[index];
+
+			auto name = m_names[index].find(observerName);
+			if (name == m_names[index].end())
+				return ErrorCode::OBSERVER_NOT_FOUND;
+
+			const auto owners = current.list->owners.get();
+			const auto pos = static_cast<size_t>(std::find_if(owners, owners + current.count, [&](const Owner& o) {
+				return o.observer->getName() == observerName; }) - owners);
+
+			// readers of older snapshots may still walk the old list, so it is copied
+			auto list = std::make_shared<ObserversList>(current.list->capacity);
+			auto s = std::make_shared<Snapshot>(*m_snapshot);
+
+			size_t i = 0;
+			for (size_t j = 0; j < current.count; ++j)
+			{
+				if (j == pos)
+					continue;
+				list->targets[i] = current.list->targets[j];
+				list->owners[i] = current.list->owners[j];
+				++i;
+			}
+			list->size = i;
+			const auto slot = current.list->targets[pos].slot;
+
+			s->observers[index] = Observers{ std::move(list), i };
+			publish(std::move(s));
+			m_names[index].erase(name);
+			releaseSlot(slot);
+			return ErrorCode::NONE;
+		}
+
+		Status Publisher::PublisherImpl::notify(EventHandle event, shared_ptr<abstraction::data::Data> event_, size_t coalescingKey) const
+		{
+			if (m_dispatcher)
+			{
+				// report an unknown event to the caller, not to a dispatcher thread
+				if (!isRegistered(*Reader{ *this }, event))
+					return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+				m_dispatcher->post(event, std::move(event_), coalescingKey);
+				return ErrorCode::NONE;
+			}
+			return dispatch(event, event_);
+		}
+
+		Status Publisher::PublisherImpl::dispatch(EventHandle event, const shared_ptr<abstraction::data::Data>& event_) const
+		{
+			const Reader snapshot{ *this };
+			if (!isRegistered(*snapshot, event))
+				return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+
+			const auto& observers = snapshot->observers[static_cast<size_t>(event)];
+
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			for (const auto& obs : observers)
+			{
+				const auto start = Statistics::clock::now();
+				obs.observer->notify(event_);
+				m_statistics->record(obs.slot, Statistics::clock::now() - start);
+			}
+#else
+			for (const auto& obs : observers)
+				obs.observer->notify(event_);
+#endif
+			return ErrorCode::NONE;
+		}
+
+		Status Publisher::PublisherImpl::notifyBatch(EventHandle event, const abstraction::data::DataBatch& batch) const
+		{
+			if (m_dispatcher)
+			{
+				if (!isRegistered(*Reader{ *this }, event))
+					return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+				// the whole batch is one queue entry, the caller's vector may go away
+				if (!batch.empty())
+					m_dispatcher->post(event, std::make_shared<const abstraction::data::DataBatch>(batch));
+				return ErrorCode::NONE;
+			}
+			return dispatchBatch(event, batch);
+		}
+
+		Status Publisher::PublisherImpl::dispatchBatch(EventHandle event, const abstraction::data::DataBatch& batch) const
+		{
+			const Reader snapshot{ *this };
+			if (!isRegistered(*snapshot, event))
+				return ErrorCode::EVENT_HANDLE_NOT_SUPPORTED;
+			if (batch.empty())
+				return ErrorCode::NONE;
+
+			const auto& observers = snapshot->observers[static_cast<size_t>(event)];
+
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			for (const auto& obs : observers)
+			{
+				const auto start = Statistics::clock::now();
+				obs.observer->notifyBatch(batch);
+				m_statistics->record(obs.slot, Statistics::clock::now() - start);
+			}
+#else
+			for (const auto& obs : observers)
+				obs.observer->notifyBatch(batch);
+#endif
+			return ErrorCode::NONE;
+		}
+
+		bool Publisher::PublisherImpl::hasObservers(EventHandle event) const
+		{
+			const Reader snapshot{ *this };
+			return isRegistered(*snapshot, event) && snapshot->observers[static_cast<size_t>(event)].count != 0;
+		}
+
+		publisher_data_abstraction::DispatchStatistics Publisher::PublisherImpl::getDispatchStatistics() const
+		{
+			if (m_dispatcher)
+				return m_dispatcher->getStatistics();
+			return publisher_data_abstraction::DispatchStatistics{};
+		}
+
+		std::vector<publisher_data_abstraction::ObserverStatistics> Publisher::PublisherImpl::getObserverStatistics() const
+		{
+			std::vector<publisher_data_abstraction::ObserverStatistics> stats;
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			{
+				std::lock_guard<std::mutex> lock{ m_writer };
+
+				std::vector<string> eventNames(m_snapshot->observers.size());
+				for (const auto& e : *m_snapshot->events)
+					eventNames[static_cast<size_t>(e.second)] = e.first;
+
+				stats.resize(m_slots.size());
+				for (size_t i = 0; i < m_slots.size(); ++i)
+				{
+					stats[i].eventName = eventNames[static_cast<size_t>(m_slots[i].first)];
+					stats[i].observerName = m_slots[i].second;
+				}
+			}
+			m_statistics->collect(stats);
+
+			// a free slot has no observer name
+			stats.erase(std::remove_if(stats.begin(), stats.end(), [](const auto& s) {
+				return s.observerName.empty(); }), stats.end());
+#endif
+			return stats;
+		}
+
+		void Publisher::PublisherImpl::resetObserverStatistics()
+		{
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			m_statistics->reset();
+#endif
+		}
+
+		size_t Publisher::PublisherImpl::acquireSlot(EventHandle event, const string& observerName)
+		{
+			if (m_freeSlots.empty())
+			{
+				m_slots.emplace_back(event, observerName);
+				m_freeSlots.reserve(m_slots.size());
+				return m_slots.size() - 1;
+			}
+
+			const auto slot = m_freeSlots.back();
+			m_slots[slot] = std::make_pair(event, observerName);
+			m_freeSlots.pop_back();
+#ifdef CLOCK_PUBLISHER_INSTRUMENTATION
+			// the counters of the previous subscription are not carried over
+			m_statistics->reset(slot);
+#endif
+			return slot;
+		}
+
+		void Publisher::PublisherImpl::releaseSlot(size_t slot) noexcept
+		{
+			m_slots[slot].second.clear();
+			m_freeSlots.push_back(slot);
+		}
+
+		Status Publisher::PublisherImpl::registerEvent(const string& eventName, EventHandle& event)
+		{
+			std::lock_guard<std::mutex> lock{ m_writer };
+
+			auto i = m_snapshot->events->find(eventName);
+			if (i != m_snapshot->events->end())
+				return ErrorCode::EVENT_ALREADY_REGISTERED;
+
+			const auto handle = static_cast<EventHandle>(m_snapshot->observers.size());
+			m_names.resize(m_snapshot->observers.size() + 1);
+
+			auto events = std::make_shared<Events>(*m_snapshot->events);
+			events->emplace(eventName, handle);
+
+			auto s = std::make_shared<Snapshot>(*m_snapshot);
+			s->observers.push_back(Observers{ std::make_shared<ObserversList>(0), 0 });
+			s->events = std::move(events);
+			publish(std::move(s));
+
+			event = handle;
+			return ErrorCode::NONE;
+		}
+
+		Status Publisher::PublisherImpl::getEventHandle(const string& eventName, EventHandle& event) const
+		{
+			const Reader snapshot{ *this };
+			const auto& events = *snapshot->events;
+
+			auto ptr = events.find(eventName);
+			if (ptr == std::end(events))
+				return ErrorCode::EVENT_NOT_SUPPORTED;
+
+			event = ptr->second;
+			return ErrorCode::NONE;
+		}
+	}
+
+	namespace tokenizer
+	{
+		namespace data
+		{
+			void TokenArena::clear()
+			{
+				m_bytes.clear();
+				m_spans.clear();
+				std::fill(m_slots.begin(), m_slots.end(), 0);
+				m_unique = 0;
+			}
+
+			void TokenArena::reserve(size_t bytes, size_t tokens)
+			{
+				m_bytes.reserve(bytes);
+				m_spans.reserve(tokens);
+			}
+
+			size_t TokenArena::add(const char* first, size_t length, Transform transform)
+			{
+				const size_t offset = m_bytes.size();
+				m_bytes.insert(m_bytes.end(), first, first + length);
+				if (transform && length)
+					transform(&m_bytes[offset], length);
+
+				m_spans.push_back(TokenSpan{ m_intern ? intern(offset, length) : offset, length });
+				return m_spans.size() - 1;
+			}
+
+			void TokenArena::add(const char* input, const std::vector<TokenSpan>& spans, Transform transform)
+			{
+				size_t bytes = 0;
+				for (const auto& span : spans)
+					bytes += span.length;
+				reserve(m_bytes.size() + bytes, m_spans.size() + spans.size());
+
+				for (const auto& span : spans)
+					add(input + span.offset, span.length, transform);
+			}
+
+			size_t TokenArena::hash(const char* first, size_t length)
+			{
+				// FNV-1a
+				uint64_t h = 14695981039346656037ull;
+				for (size_t i = 0; i < length; ++i)
+					h = (h ^ static_cast<unsigned char>(first[i])) * 1099511628211ull;
+				return static_cast<size_t>(h ^ (h >> 32));
+			}
+
+			// returns the offset the token should use, dropping the bytes just appended when an equal token exists
+			size_t TokenArena::intern(size_t offset, size_t length)
+			{
+				if ((m_unique + 1) * 2 > m_slots.size())
+					grow();
+
+				const char* token = m_bytes.data() + offset;
+				const size_t mask = m_slots.size() - 1;
+				for (size_t i = hash(token, length) & mask; ; i = (i + 1) & mask)
+				{
+					if (!m_slots[i])
+					{
+						m_slots[i] = m_spans.size() + 1;
+						++m_unique;
+						return offset;
+					}
+
+					const auto& other = m_spans[m_slots[i] - 1];
+					if (other.length == length && std::equal(token, token + length, m_bytes.data() + other.offset))
+					{
+						m_bytes.resize(offset);
+						return other.offset;
+					}
+				}
+			}
+
+			void TokenArena::grow()
+			{
+				std::vector<size_t> slots(std::max<size_t>(16, m_slots.size() * 2), 0);
+				const size_t mask = slots.size() - 1;
+
+				for (auto index : m_slots)
+				{
+					if (!index)
+						continue;
+					const auto& span = m_spans[index - 1];
+					size_t i = hash(m_bytes.data() + span.offset, span.length) & mask;
+					while (slots[i])
+						i = (i + 1) & mask;
+					slots[i] = index;
+				}
+				m_slots.swap(slots);
+			}
+		}
+
+		namespace logic
+		{
+			namespace business
+			{
+				static bool isSeparator(char c, char delimiter)
+				{
+					return c == delimiter || c == ' ' || (c >= '\t' && c <= '\r');
+				}
+
+				struct ScanState
+				{
+					size_t begin;
+					bool inToken;
+				};
+
+				static void scanScalar(const char* first, size_t from, size_t to, char delimiter, ScanState& st, std::vector<data::TokenSpan>& spans)
+				{
+					for (size_t i = from; i < to; ++i)
+					{
+						const bool sep = isSeparator(first[i], delimiter);
+						if (st.inToken && sep)
+							spans.push_back(data::TokenSpan{ st.begin, i - st.begin });
+						else if (!st.inToken && !sep)
+							st.begin = i;
+						st.inToken = !sep;
+					}
+				}
+
+				static void upperScalar(char* first, size_t from, size_t to)
+				{
+					for (size_t i = from; i < to; ++i)
+						if (first[i] >= 'a' && first[i] <= 'z')
+							first[i] = static_cast<char>(first[i] - ('a' - 'A'));
+				}
+
+#ifdef CLOCK_X86
+				static unsigned countTrailingZeros(uint32_t x)
+				{
+#ifdef _MSC_VER
+					unsigned long i;
+					_BitScanForward(&i, x);
+					return static_cast<unsigned>(i);
+#else
+					return static_cast<unsigned>(__builtin_ctz(x));
+#endif
+				}
+
+				// nonSep has bit i set when byte base + i is part of a token
+				static void emitEdges(uint32_t nonSep, unsigned width, size_t base, ScanState& st, std::vector<data::TokenSpan>& spans)
+				{
+					const uint32_t all = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+					const uint32_t prev = (nonSep << 1) | (st.inToken ? 1u : 0u);
+
+					for (uint32_t edges = (nonSep ^ prev) & all; edges; edges &= edges - 1)
+					{
+						const unsigned i = countTrailingZeros(edges);
+						if ((nonSep >> i) & 1u)
+							st.begin = base + i;
+						else
+							spans.push_back(data::TokenSpan{ st.begin, base + i - st.begin });
+					}
+					st.inToken = ((nonSep >> (width - 1)) & 1u) != 0;
+				}
+
+				CLOCK_TARGET("sse2") static void scanSSE2(const char* first, size_t size, char delimiter, ScanState& st, std::vector<data::TokenSpan>& spans)
+				{
+					const __m128i delim = _mm_set1_epi8(delimiter);
+					const __m128i space = _mm_set1_epi8(' ');
+					const __m128i tab = _mm_set1_epi8('\t');
+					const __m128i four = _mm_set1_epi8(4);
+
+					size_t i = 0;
+					for (; i + 16 <= size; i += 16)
+					{
+						const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+						// '\t'..'\r' is the unsigned range [0, 4] once '\t' is subtracted
+						const __m128i ctl = _mm_sub_epi8(v, tab);
+						const __m128i sep = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, delim), _mm_cmpeq_epi8(v, space)),
+							_mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl));
+						emitEdges(~static_cast<uint32_t>(_mm_movemask_epi8(sep)) & 0xFFFFu, 16, i, st, spans);
+					}
+					scanScalar(first, i, size, delimiter, st, spans);
+				}
+
+				CLOCK_TARGET("avx2") static void scanAVX2(const char* first, size_t size, char delimiter, ScanState& st, std::vector<data::TokenSpan>& spans)
+				{
+					const __m256i delim = _mm256_set1_epi8(delimiter);
+					const __m256i space = _mm256_set1_epi8(' ');
+					const __m256i tab = _mm256_set1_epi8('\t');
+					const __m256i four = _mm256_set1_epi8(4);
+
+					size_t i = 0;
+					for (; i + 32 <= size; i += 32)
+					{
+						const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+						const __m256i ctl = _mm256_sub_epi8(v, tab);
+						const __m256i sep = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, delim), _mm256_cmpeq_epi8(v, space)),
+							_mm256_cmpeq_epi8(_mm256_min_epu8(ctl, four), ctl));
+						emitEdges(~static_cast<uint32_t>(_mm256_movemask_epi8(sep)), 32, i, st, spans);
+					}
+					scanScalar(first, i, size, delimiter, st, spans);
+				}
+
+				CLOCK_TARGET("sse2") static void upperSSE2(char* first, size_t size)
+				{
+					const __m128i a = _mm_set1_epi8('a');
+					const __m128i range = _mm_set1_epi8('z' - 'a');
+					const __m128i diff = _mm_set1_epi8('a' - 'A');
+
+					size_t i = 0;
+					for (; i + 16 <= size; i += 16)
+					{
+						const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+						const __m128i t = _mm_sub_epi8(v, a);
+						const __m128i lower = _mm_cmpeq_epi8(_mm_min_epu8(t, range), t);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(first + i), _mm_sub_epi8(v, _mm_and_si128(lower, diff)));
+					}
+					upperScalar(first, i, size);
+				}
+
+				CLOCK_TARGET("avx2") static void upperAVX2(char* first, size_t size)
+				{
+					const __m256i a = _mm256_set1_epi8('a');
+					const __m256i range = _mm256_set1_epi8('z' - 'a');
+					const __m256i diff = _mm256_set1_epi8('a' - 'A');
+
+					size_t i = 0;
+					for (; i + 32 <= size; i += 32)
+					{
+						const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+						const __m256i t = _mm256_sub_epi8(v, a);
+						const __m256i lower = _mm256_cmpeq_epi8(_mm256_min_epu8(t, range), t);
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(first + i), _mm256_sub_epi8(v, _mm256_and_si256(lower, diff)));
+					}
+					upperScalar(first, i, size);
+				}
+
+				static void cpuid(int regs[4], int leaf)
+				{
+#ifdef _MSC_VER
+					__cpuidex(regs, leaf, 0);
+#else
+					unsigned r[4]{};
+					__cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+					for (int i = 0; i < 4; ++i)
+						regs[i] = static_cast<int>(r[i]);
+#endif
+				}
+
+				static uint64_t xgetbv0()
+				{
+#ifdef _MSC_VER
+					return _xgetbv(0);
+#else
+					uint32_t lo, hi;
+					__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+					return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+				}
+#endif
+
+				static SimdLevel detectSimdLevel()
+				{
+#ifdef CLOCK_X86
+					int regs[4];
+					cpuid(regs, 0);
+					const int maxLeaf = regs[0];
+
+					cpuid(regs, 1);
+					if (!(regs[3] & (1 << 26)))
+						return SimdLevel::Scalar;
+
+					// AVX2 also needs the os to save the ymm registers
+					const bool osxsave = (regs[2] & (1 << 27)) != 0;
+					const bool avx = (regs[2] & (1 << 28)) != 0;
+					if (maxLeaf >= 7 && osxsave && avx && (xgetbv0() & 6) == 6)
+					{
+						cpuid(regs, 7);
+						if (regs[1] & (1 << 5))
+							return SimdLevel::AVX2;
+					}
+					return SimdLevel::SSE2;
+#else
+					return SimdLevel::Scalar;
+#endif
+				}
+
+				SimdLevel getSimdLevel() noexcept
+				{
+					static const SimdLevel level = detectSimdLevel();
+					return level;
+				}
+
+				void tokenize(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans)
+				{
+					tokenize(first, size, delimiter, spans, getSimdLevel());
+				}
+
+				void tokenize(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans, SimdLevel level)
+				{
+					ScanState st{ 0, false };
+
+					switch ((std::min)(level, getSimdLevel()))
+					{
+#ifdef CLOCK_X86
+					case SimdLevel::AVX2: scanAVX2(first, size, delimiter, st, spans); break;
+					case SimdLevel::SSE2: scanSSE2(first, size, delimiter, st, spans); break;
+#endif
+					default: scanScalar(first, 0, size, delimiter, st, spans); break;
+					}
+
+					if (st.inToken)
+						spans.push_back(data::TokenSpan{ st.begin, size - st.begin });
+				}
+
+				void toUpper(char* first, size_t size)
+				{
+					toUpper(first, size, getSimdLevel());
+				}
+
+				void toUpper(char* first, size_t size, SimdLevel level)
+				{
+					switch ((std::min)(level, getSimdLevel()))
+					{
+#ifdef CLOCK_X86
+					case SimdLevel::AVX2: upperAVX2(first, size); break;
+					case SimdLevel::SSE2: upperSSE2(first, size); break;
+#endif
+					default: upperScalar(first, 0, size); break;
+					}
+				}
+
+				// created on the first large input and shared by every caller, the calling thread takes a range too;
+				// not the broker's pool, a job already running on it would wait for itself
+				static broker_system::WorkerPool& getTokenizerPool()
+				{
+					static broker_system::WorkerPool pool{ (std::max)(2u, std::thread::hardware_concurrency()) - 1 };
+					return pool;
+				}
+
+				// tokenizeRange(first, size, spans) appends the spans of one range, relative to that range
+				template<class IsSeparator, class TokenizeRange>
+				static void splitParallel(const char* first, size_t size, std::vector<data::TokenSpan>& spans, unsigned threads,
+					IsSeparator isSeparator, TokenizeRange tokenizeRange)
+				{
+					// below this a range is not worth a thread
+					const size_t minRange = 256 * 1024;
+
+					if (!threads)
+						threads = (std::max)(1u, std::thread::hardware_concurrency());
+					const auto workers = static_cast<size_t>(std::min<size_t>(threads, size / minRange));
+					if (workers < 2)
+					{
+						tokenizeRange(first, size, spans);
+						return;
+					}
+
+					// move each cut forward to a separator so that no token is split
+					std::vector<size_t> cuts(workers + 1, size);
+					cuts[0] = 0;
+					for (size_t w = 1; w < workers; ++w)
+					{
+						size_t cut = (std::max)(size / workers * w, cuts[w - 1]);
+						while (cut < size && !isSeparator(first[cut]))
+							++cut;
+						cuts[w] = cut;
+					}
+
+					std::vector<std::vector<data::TokenSpan>> parts(workers);
+					std::vector<std::exception_ptr> errors(workers);
+					auto work = [&](size_t w) {
+						try
+						{
+							tokenizeRange(first + cuts[w], cuts[w + 1] - cuts[w], parts[w]);
+							for (auto& span : parts[w])
+								span.offset += cuts[w];
+						}
+						catch (...)
+						{
+							errors[w] = std::current_exception();
+						}
+					};
+
+					std::mutex mutex;
+					std::condition_variable done;
+					size_t pending = workers - 1;
+					auto finish = [&] {
+						// notified under the lock, the caller may return as soon as it gets it
+						std::lock_guard<std::mutex> lock{ mutex };
+						if (--pending == 0)
+							done.notify_one();
+					};
+
+					auto& pool = getTokenizerPool();
+					for (size_t w = 1; w < workers; ++w)
+					{
+						try
+						{
+							pool.post([&, w] { work(w); finish(); });
+						}
+						catch (...)
+						{
+							// the range is not lost, this thread takes it
+							work(w);
+							finish();
+						}
+					}
+					work(0);
+					{
+						std::unique_lock<std::mutex> lock{ mutex };
+						done.wait(lock, [&] { return pending == 0; });
+					}
+
+					for (auto& e : errors)
+						if (e)
+							std::rethrow_exception(e);
+
+					size_t total = spans.size();
+					for (const auto& part : parts)
+						total += part.size();
+					spans.reserve(total);
+					for (const auto& part : parts)
+						spans.insert(spans.end(), part.cbegin(), part.cend());
+				}
+
+				void tokenizeParallel(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans, unsigned threads)
+				{
+					splitParallel(first, size, spans, threads,
+						[delimiter](char c) { return isSeparator(c, delimiter); },
+						[delimiter](const char* f, size_t n, std::vector<data::TokenSpan>& s) { tokenize(f, n, delimiter, s); });
+				}
+
+				void tokenizeParallel(const CharTable& separators, const char* first, size_t size, std::vector<data::TokenSpan>& spans, unsigned threads)
+				{
+					splitParallel(first, size, spans, threads,
+						[&separators](char c) { return separators[c] != 0; },
+						[&separators](const char* f, size_t n, std::vector<data::TokenSpan>& s) { TableTokenizer<NoTransform>::tokenize(separators, f, n, s); });
+				}
+
+				CharTable makeDelimiterTable(const std::string& delimiters)
+				{
+					CharTable t{};
+					for (auto c : delimiters)
+						t.value[static_cast<unsigned char>(c)] = 1;
+					return t;
+				}
+
+				void StreamTokenizer::reset()
+				{
+					m_carry.clear();
+					m_carryOffset = 0;
+					m_offset = 0;
+					m_count = 0;
+				}
+
+				void StreamTokenizer::feed(const char* first, size_t size, bool last, const TokenCallback& callback)
+				{
+					m_spans.clear();
+					business::tokenize(first, size, m_delimiter, m_spans);
+
+					size_t i = 0;
+					if (!m_carry.empty())
+					{
+						// the carried token goes on only if this chunk starts inside a token
+						if (!m_spans.empty() && m_spans[0].offset == 0)
+						{
+							m_carry.append(first, m_spans[0].length);
+							i = 1;
+							if (m_spans[0].length == size && !last)
+							{
+								m_offset += size;
+								return;
+							}
+						}
+						callback(m_carry.data(), m_carry.size(), m_carryOffset);
+						++m_count;
+						m_carry.clear();
+					}
+
+					for (; i < m_spans.size(); ++i)
+					{
+						const auto& span = m_spans[i];
+						if (!last && span.offset + span.length == size)
+						{
+							m_carry.assign(first + span.offset, span.length);
+							m_carryOffset = m_offset + span.offset;
+							break;
+						}
+						callback(first + span.offset, span.length, m_offset + span.offset);
+						++m_count;
+					}
+					m_offset += size;
+				}
+
+				uint64_t StreamTokenizer::tokenize(std::istream& in, const TokenCallback& callback)
+				{
+					reset();
+
+					std::vector<char> buffer(m_chunkSize);
+					while (in)
+					{
+						in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+						const auto n = static_cast<size_t>(in.gcount());
+						if (n)
+							feed(buffer.data(), n, false, callback);
+					}
+					feed(nullptr, 0, true, callback);
+
+					return m_count;
+				}
+
+				static void throwFileError(const char* what)
+				{
+					std::ostringstream oss;
+					oss << what << " failed with error " << GetLastError();
+					throw abstraction::data::exception::Exception(oss.str());
+				}
+
+				uint64_t StreamTokenizer::tokenizeFile(const std::wstring& path, const TokenCallback& callback)
+				{
+					reset();
+
+					HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+					if (file == INVALID_HANDLE_VALUE)
+						throwFileError("CreateFileW");
+					std::unique_ptr<void, decltype(&CloseHandle)> fileGuard{ file, &CloseHandle };
+
+					LARGE_INTEGER size;
+					if (!GetFileSizeEx(file, &size))
+						throwFileError("GetFileSizeEx");
+					const auto total = static_cast<uint64_t>(size.QuadPart);
+
+					if (total)
+					{
+						HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+						if (!mapping)
+							throwFileError("CreateFileMappingW");
+						std::unique_ptr<void, decltype(&CloseHandle)> mappingGuard{ mapping, &CloseHandle };
+
+						// views must start on the allocation granularity
+						SYSTEM_INFO info;
+						GetSystemInfo(&info);
+						const uint64_t granularity = info.dwAllocationGranularity;
+						const uint64_t window = std::max<uint64_t>(granularity, m_chunkSize / granularity * granularity);
+
+						for (uint64_t pos = 0; pos < total; pos += window)
+						{
+							const auto length = static_cast<size_t>(std::min<uint64_t>(window, total - pos));
+							const void* view = MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(pos >> 32), static_cast<DWORD>(pos & 0xFFFFFFFF), length);
+							if (!view)
+								throwFileError("MapViewOfFile");
+							std::unique_ptr<const void, decltype(&UnmapViewOfFile)> viewGuard{ view, &UnmapViewOfFile };
+
+							feed(static_cast<const char*>(view), length, false, callback);
+						}
+					}
+					feed(nullptr, 0, true, callback);
+
+					return m_count;
+				}
+			} // namespace business
+
+			namespace service
+			{
+				const std::string TokenizerService::name = "tokenizer";
+
+				TokenizerService::~TokenizerService()
+				{
+				}
+
+				void TokenizerService::tokenize(const char* first, size_t size, char delimiter, vector<data::TokenSpan>& spans) const
+				{
+					if (m_threads == 1)
+						business::tokenize(first, size, delimiter, spans);
+					else
+						business::tokenizeParallel(first, size, delimiter, spans, m_threads);
+				}
+
+				static data::TokenArena::Transform getCaseFunction(data::CaseTransform ct)
+				{
+					switch (ct)
+					{
+					case data::CaseTransform::Upper: return [](char* p, size_t n) { business::toUpper(p, n); };
+					case data::CaseTransform::Lower: return &business::TableTokenizer<business::LowerTransform>::transform;
+					default: return nullptr;
+					}
+				}
+
+				static void emplaceTokens(const string& ss, const vector<data::TokenSpan>& spans, data::CaseTransform ct, data::TokenizerOutputData& out)
+				{
+					const auto caseFunction = getCaseFunction(ct);
+					out.reserve(spans.size());
+					for (const auto& span : spans)
+					{
+						out.emplace_back(ss.data() + span.offset, span.length);
+						if (caseFunction)
+							caseFunction(&out.back()[0], span.length);
+					}
+				}
+
+				void TokenizerService::tokenize(const char* first, size_t size, char delimiter, data::CaseTransform ct, data::TokenArena& arena) const
+				{
+					// scratch spans into the input, kept per thread so that steady state calls do not allocate
+					thread_local vector<data::TokenSpan> spans;
+					spans.clear();
+					tokenize(first, size, delimiter, spans);
+
+					arena.clear();
+					arena.add(first, spans, getCaseFunction(ct));
+				}
+
+				void TokenizerService::tokenize(const data::TokenizerInputData& in, data::TokenizerOutputData& out) const
+				{
+					const string& ss = in.getData();
+
+					thread_local vector<data::TokenSpan> spans;
+					spans.clear();
+
+					// several delimiters go through the lookup table specialisation for the case transform
+					if (in.getDelimiters().size() != 1)
+					{
+						const auto separators = business::SplitOnWhitespace::apply(business::makeDelimiterTable(in.getDelimiters()));
+						if (m_threads != 1)
+						{
+							// split like a single delimiter, the case transform then runs per token
+							business::tokenizeParallel(separators, ss.data(), ss.size(), spans, m_threads);
+							emplaceTokens(ss, spans, in.getCaseTransform(), out);
+							return;
+						}
+						switch (in.getCaseTransform())
+						{
+						case data::CaseTransform::None:
+							business::TableTokenizer<business::NoTransform>::tokenize(separators, ss.data(), ss.size(), out);
+							break;
+						case data::CaseTransform::Upper:
+							business::TableTokenizer<business::UpperTransform>::tokenize(separators, ss.data(), ss.size(), out);
+							break;
+						case data::CaseTransform::Lower:
+							business::TableTokenizer<business::LowerTransform>::tokenize(separators, ss.data(), ss.size(), out);
+							break;
+						}
+						return;
+					}
+
+					tokenize(ss.data(), ss.size(), in.getToken(), spans);
+					emplaceTokens(ss, spans, in.getCaseTransform(), out);
+				}
+
+				abstraction::data::OutputData* TokenizerService::transform(std::shared_ptr<abstraction::data::InputData> d) {
+					return d ? transformInput(*d) : nullptr;
+				}
+
+				abstraction::data::OutputData* TokenizerService::transformInput(const abstraction::data::InputData& d) const
+				{
+					if (auto in = dynamic_cast<const data::TokenizerArenaInputData*>(&d))
+					{
+						tokenize(in->getData(), in->getSize(), in->getToken(), in->getCaseTransform(), *in->getArena());
+						return new data::TokenizerArenaOutputData(in->getArena());
+					}
+
+					if (auto view = dynamic_cast<const data::TokenizerViewInputData*>(&d))
+					{
+						vector<data::TokenSpan> spans;
+						tokenize(view->getData(), view->getSize(), view->getToken(), spans);
+						return new data::TokenizerSpanOutputData(view->getData(), std::move(spans));
+					}
+
+					auto data = dynamic_cast<const data::TokenizerInputData*>(&d);
+					if (!data)
+						return nullptr;
+
+					auto out = std::make_unique<data::TokenizerOutputData>();
+					tokenize(*data, *out);
+					return out.release();
+				}
+
+				abstraction::data::unique_output_ptr TokenizerService::transformOwned(std::shared_ptr<abstraction::data::InputData> d)
+				{
+					// the input is only read, owning it changes nothing
+					if (!d)
+						return abstraction::data::make_unique_output_ptr(nullptr);
+					return transformBorrowed(*d);
+				}
+
+				abstraction::data::unique_output_ptr TokenizerService::transformBorrowed(const abstraction::data::InputData& d)
+				{
+					auto data = dynamic_cast<const data::TokenizerInputData*>(&d);
+					if (!data)
+						return abstraction::data::make_unique_output_ptr(transformInput(d));
+
+					auto out = abstraction::data::make_unique_output_ptr(nullptr);
+					auto* tokens = m_pool->acquire();
+					out.reset(tokens);
+					tokens->attach(m_pool);
+
+					tokenize(*data, *tokens);
+					return out;
+				}
+
+				bool TokenizerService::makeCacheKey(const abstraction::data::InputData& d, std::string& key) const
+				{
+					const auto* in = dynamic_cast<const data::TokenizerInputData*>(&d);
+					if (!in)
+						return false;
+
+					// the delimiters are length prefixed, so the key is unambiguous
+					key += static_cast<char>('0' + static_cast<int>(in->getCaseTransform()));
+					key += std::to_string(in->getDelimiters().size());
+					key += ':';
+					key += in->getDelimiters();
+					key += in->getData();
+					return true;
+				}
+
+				size_t TokenizerService::getResultSize(const abstraction::data::OutputData& d) const
+				{
+					const auto* out = dynamic_cast<const data::TokenizerOutputData*>(&d);
+					if (!out)
+						return IService::getResultSize(d);
+
+					// a recycled result holds more than its tokens, the budget has to see all of it
+					return out->getByteSize();
+				}
+
+				void TokenizerService::transformBatch(const abstraction::data::InputBatch& in, abstraction::data::OutputBatch& out)
+				{
+					// one pool lock for the outputs of the whole batch
+					std::vector<std::unique_ptr<data::TokenizerOutputData>> results;
+					m_pool->acquireBatch(in.size(), results);
+					out.reserve(out.size() + in.size());
+
+					for (size_t i = 0; i < in.size(); ++i)
+					{
+						const auto* input = dynamic_cast<const data::TokenizerInputData*>(in[i].get());
+						if (!input)
+						{
+							// its output goes back to the pool below
+							out.push_back(IService::transformOwned(in[i]));
+							continue;
+						}
+
+						auto* tokens = results[i].release();
+						out.push_back(abstraction::data::make_unique_output_ptr(tokens));
+						tokens->attach(m_pool);
+
+						tokenize(*input, *tokens);
+					}
+
+					for (auto& unused : results)
+					{
+						if (unused)
+							m_pool->release(unused.release());
+					}
+				}
+
+				// input: case transform (1 byte), delimiter count (4 bytes), delimiters, the string up to the end
+				// output: token count (8 bytes), then per token its length (4 bytes) and bytes
+				template<class T>
+				static char* writeValue(char* out, T value)
+				{
+					std::memcpy(out, &value, sizeof(T));
+					return out + sizeof(T);
+				}
+
+				template<class T>
+				static bool readValue(const char*& in, const char* end, T& value)
+				{
+					if (static_cast<size_t>(end - in) < sizeof(T))
+						return false;
+					std::memcpy(&value, in, sizeof(T));
+					in += sizeof(T);
+					return true;
+				}
+
+				bool TokenizerCodec::measureInput(const abstraction::data::InputData& d, size_t& size) const
+				{
+					const auto* in = dynamic_cast<const data::TokenizerInputData*>(&d);
+					if (!in || in->getDelimiters().size() > UINT32_MAX)
+						return false;
+					size = sizeof(uint8_t) + sizeof(uint32_t) + in->getDelimiters().size() + in->getData().size();
+					return true;
+				}
+
+				void TokenizerCodec::writeInput(const abstraction::data::InputData& d, char* out) const
+				{
+					const auto& in = static_cast<const data::TokenizerInputData&>(d);
+					out = writeValue(out, static_cast<uint8_t>(in.getCaseTransform()));
+					out = writeValue(out, static_cast<uint32_t>(in.getDelimiters().size()));
+					out = std::copy(in.getDelimiters().begin(), in.getDelimiters().end(), out);
+					std::copy(in.getData().begin(), in.getData().end(), out);
+				}
+
+				std::shared_ptr<abstraction::data::InputData> TokenizerCodec::readInput(const char* in, size_t size) const
+				{
+					const char* end = in + size;
+					uint8_t ct;
+					uint32_t delimiters;
+					if (!readValue(in, end, ct) || ct > static_cast<uint8_t>(data::CaseTransform::Lower) || !readValue(in, end, delimiters))
+						return nullptr;
+					// no delimiter is valid, whitespace alone splits the tokens as it does in process
+					if (static_cast<size_t>(end - in) < delimiters)
+						return nullptr;
+
+					return std::make_shared<data::TokenizerInputData>(std::string(in + delimiters, end), std::string(in, delimiters), static_cast<data::CaseTransform>(ct));
+				}
+
+				bool TokenizerCodec::measureOutput(const abstraction::data::OutputData& d, size_t& size) const
+				{
+					const auto* out = dynamic_cast<const data::TokenizerOutputData*>(&d);
+					if (!out)
+						return false;
+
+					size = sizeof(uint64_t);
+					for (const auto& token : *out)
+					{
+						if (token.size() > UINT32_MAX)
+							return false;
+						size += sizeof(uint32_t) + token.size();
+					}
+					return true;
+				}
+
+				void TokenizerCodec::writeOutput(const abstraction::data::OutputData& d, char* out) const
+				{
+					const auto& tokens = static_cast<const data::TokenizerOutputData&>(d);
+					out = writeValue(out, static_cast<uint64_t>(tokens.size()));
+					for (const auto& token : tokens)
+					{
+						out = writeValue(out, static_cast<uint32_t>(token.size()));
+						out = std::copy(token.begin(), token.end(), out);
+					}
+				}
+
+				abstraction::data::unique_output_ptr TokenizerCodec::readOutput(const char* in, size_t size) const
+				{
+					const char* end = in + size;
+					uint64_t count;
+					// every token takes its length at least, a larger count is corrupt
+					if (!readValue(in, end, count) || count > static_cast<uint64_t>(end - in) / sizeof(uint32_t))
+						return abstraction::data::make_unique_output_ptr(nullptr);
+
+					auto out = abstraction::data::make_unique_output_ptr(nullptr);
+					auto* tokens = m_pool->acquire();
+					out.reset(tokens);
+					tokens->attach(m_pool);
+
+					tokens->reserve(static_cast<size_t>(count));
+					for (uint64_t i = 0; i < count; ++i)
+					{
+						uint32_t length;
+						if (!readValue(in, end, length) || static_cast<size_t>(end - in) < length)
+							return abstraction::data::make_unique_output_ptr(nullptr);
+						tokens->emplace_back(in, length);
+						in += length;
+					}
+					return out;
+				}
+
+			}
+		}
+	}
+
+	namespace profiler
+	{
+		// phases open on this thread, a phase started inside another one is nested in it
+		static thread_local unsigned openPhases = 0;
+
+		StartupProfiler& StartupProfiler::getInstance()
+		{
+			static StartupProfiler instance;
+			return instance;
+		}
+
+		StartupProfiler::StartupProfiler() : m_origin{ clock::now() }, m_mutex{}, m_phases{}
+		{
+		}
+
+		void StartupProfiler::record(const char* name, clock::time_point start, clock::duration duration, unsigned depth)
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_phases.push_back(Phase{ name, start - m_origin, duration, depth });
+		}
+
+		std::vector<StartupProfiler::Phase> StartupProfiler::getPhases() const
+		{
+			std::vector<Phase> phases;
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				phases = m_phases;
+			}
+			// recorded as they finish, an enclosing phase finishes after the ones it contains
+			std::stable_sort(phases.begin(), phases.end(), [](const Phase& a, const Phase& b) { return a.start < b.start; });
+			return phases;
+		}
+
+		void StartupProfiler::report(std::ostream& os) const
+		{
+			using milliseconds = std::chrono::duration<double, std::milli>;
+
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(3);
+			out << "startup phases (start, duration in ms)\n";
+			for (const auto& phase : getPhases())
+			{
+				out << std::setw(10) << milliseconds(phase.start).count()
+					<< std::setw(10) << milliseconds(phase.duration).count() << "  "
+					<< std::string(2 * phase.depth, ' ') << phase.name << '\n';
+			}
+			os << out.str();
+		}
+
+		ScopedPhase::ScopedPhase(const char* name)
+			: m_name{ name }, m_start{}, m_depth{ openPhases++ }
+		{
+			// creates the profiler first, its origin has to come before the start
+			StartupProfiler::getInstance();
+			m_start = StartupProfiler::clock::now();
+		}
+
+		ScopedPhase::~ScopedPhase()
+		{
+			const auto end = StartupProfiler::clock::now();
+			--openPhases;
+			try
+			{
+				StartupProfiler::getInstance().record(m_name, m_start, end - m_start, m_depth);
+			}
+			catch (...)
+			{
+				// a lost measurement is not worth failing the phase for
+			}
+		}
+	}
+}
+
+namespace broker_system
+{
+	class WorkerPool::WorkerPoolImpl
+	{
+	public:
+		explicit WorkerPoolImpl(unsigned threads);
+		~WorkerPoolImpl();
+
+		void post(std::function<void()> job);
+		unsigned getThreadCount() const noexcept { return static_cast<unsigned>(m_threads.size()); }
+
+	private:
+		void run();
+
+		std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::deque<std::function<void()>> m_jobs;
+		bool m_stop{};
+		std::vector<std::thread> m_threads;
+	};
+
+	WorkerPool::WorkerPoolImpl::WorkerPoolImpl(unsigned threads)
+	{
+		if (!threads)
+			threads = (std::max)(1u, std::thread::hardware_concurrency());
+
+		m_threads.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+			m_threads.emplace_back(&WorkerPoolImpl::run, this);
+	}
+
+	WorkerPool::WorkerPoolImpl::~WorkerPoolImpl()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_stop = true;
+		}
+		m_ready.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+	}
+
+	void WorkerPool::WorkerPoolImpl::post(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_jobs.push_back(std::move(job));
+		}
+		m_ready.notify_one();
+	}
+
+	void WorkerPool::WorkerPoolImpl::run()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock{ m_mutex };
+				m_ready.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+				if (m_jobs.empty())
+					return;
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+
+			try
+			{
+				job();
+			}
+			catch (...)
+			{
+				// a job reports its own errors, the worker keeps going
+			}
+		}
+	}
+
+	WorkerPool::WorkerPool(unsigned threads) : pimpl_{ std::make_unique<WorkerPoolImpl>(threads) }
+	{
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+	}
+
+	void WorkerPool::post(std::function<void()> job)
+	{
+		pimpl_->post(std::move(job));
+	}
+
+	unsigned WorkerPool::getThreadCount() const noexcept
+	{
+		return pimpl_->getThreadCount();
+	}
+
+	namespace white_page
+	{
+		class ResultCache::ResultCacheImpl
+		{
+		public:
+			explicit ResultCacheImpl(size_t byteBudget) : m_budget{ byteBudget } {}
+
+			void setBudget(size_t byteBudget);
+			bool isEnabled() const noexcept { return m_budget.load(std::memory_order_relaxed) != 0; }
+
+			std::shared_ptr<const abstraction::data::OutputData> find(const std::string& key);
+			void insert(const std::string& key, std::shared_ptr<const abstraction::data::OutputData> value, size_t bytes);
+			void clear();
+
+			ResultCache::Statistics getStatistics() const;
+
+		private:
+			struct Entry
+			{
+				std::string key;
+				std::shared_ptr<const abstraction::data::OutputData> value;
+				size_t bytes;
+			};
+
+			// most recently used first
+			using Entries = std::list<Entry>;
+
+			void evict(size_t budget);
+
+			std::atomic<size_t> m_budget;
+			mutable std::mutex m_mutex;
+			Entries m_entries;
+			std::unordered_map<std::string, Entries::iterator> m_index;
+			size_t m_bytes{};
+			size_t m_hits{};
+			size_t m_misses{};
+			size_t m_evictions{};
+		};
+
+		void ResultCache::ResultCacheImpl::setBudget(size_t byteBudget)
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_budget = byteBudget;
+			evict(byteBudget);
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> ResultCache::ResultCacheImpl::find(const std::string& key)
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+
+			auto ptr = m_index.find(key);
+			if (ptr == m_index.end())
+			{
+				++m_misses;
+				return nullptr;
+			}
+
+			++m_hits;
+			m_entries.splice(m_entries.begin(), m_entries, ptr->second);
+			return ptr->second->value;
+		}
+
+		void ResultCache::ResultCacheImpl::insert(const std::string& key, std::shared_ptr<const abstraction::data::OutputData> value, size_t bytes)
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+
+			const size_t budget = m_budget;
+			if (bytes > budget)
+				return;
+
+			// another thread may have computed the same result meanwhile
+			auto ptr = m_index.find(key);
+			if (ptr != m_index.end())
+			{
+				m_bytes -= ptr->second->bytes;
+				m_entries.erase(ptr->second);
+				m_index.erase(ptr);
+			}
+
+			evict(budget - bytes);
+			m_entries.push_front(Entry{ key, std::move(value), bytes });
+			try
+			{
+				m_index.emplace(key, m_entries.begin());
+			}
+			catch (...)
+			{
+				// an entry missing from the index could never be found nor evicted
+				m_entries.pop_front();
+				throw;
+			}
+			m_bytes += bytes;
+		}
+
+		void ResultCache::ResultCacheImpl::evict(size_t budget)
+		{
+			while (m_bytes > budget && !m_entries.empty())
+			{
+				auto& last = m_entries.back();
+				m_bytes -= last.bytes;
+				m_index.erase(last.key);
+				m_entries.pop_back();
+				++m_evictions;
+			}
+		}
+
+		void ResultCache::ResultCacheImpl::clear()
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_index.clear();
+			m_entries.clear();
+			m_bytes = 0;
+		}
+
+		ResultCache::Statistics ResultCache::ResultCacheImpl::getStatistics() const
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			return ResultCache::Statistics{ m_hits, m_misses, m_evictions, m_entries.size(), m_bytes, m_budget };
+		}
+
+		ResultCache::ResultCache(size_t byteBudget) : pimpl_{ std::make_unique<ResultCacheImpl>(byteBudget) }
+		{
+		}
+
+		ResultCache::~ResultCache()
+		{
+		}
+
+		void ResultCache::setBudget(size_t byteBudget)
+		{
+			pimpl_->setBudget(byteBudget);
+		}
+
+		bool ResultCache::isEnabled() const noexcept
+		{
+			return pimpl_->isEnabled();
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> ResultCache::find(const std::string& key)
+		{
+			return pimpl_->find(key);
+		}
+
+		void ResultCache::insert(const std::string& key, std::shared_ptr<const abstraction::data::OutputData> value, size_t bytes)
+		{
+			pimpl_->insert(key, std::move(value), bytes);
+		}
+
+		void ResultCache::clear()
+		{
+			pimpl_->clear();
+		}
+
+		ResultCache::Statistics ResultCache::getStatistics() const
+		{
+			return pimpl_->getStatistics();
+		}
+
+		BrokerForwarder::BrokerForwarder() : m_services{}
+		{
+			service_system::profiler::ScopedPhase phase{ "BrokerForwarder" };
+
+			m_services.insert(std::make_pair("tokenizer", std::make_unique<LazyService>([]() -> std::unique_ptr<abstraction::logic::service::IService>
+			{
+				service_system::profiler::ScopedPhase phase{ "BrokerForwarder tokenizer" };
+				return std::make_unique<service_system::tokenizer::logic::service::TokenizerService>();
+			})));
+#ifdef CLOCK_REMOTE_SERVICES
+			// the same service in a host process, started on the first request
+			m_services.insert(std::make_pair("tokenizer.remote", std::make_unique<LazyService>([]() -> std::unique_ptr<abstraction::logic::service::IService>
+			{
+				return std::make_unique<remote::RemoteService>("tokenizer", std::make_shared<service_system::tokenizer::logic::service::TokenizerCodec>());
+			})));
+#endif
+		}
+
+		ServiceHandle BrokerForwarder::resolve(const std::string& serviceName) const noexcept
+		{
+			auto ptr = m_services.find(serviceName);
+			if (ptr == m_services.cend())
+				return ServiceHandle{};
+
+			try
+			{
+				return ServiceHandle{ ptr->second->get().get() };
+			}
+			catch (...)
+			{
+				// the service could not be built, it is tried again on the next resolve
+				return ServiceHandle{};
+			}
+		}
+
+		abstraction::data::unique_output_ptr BrokerForwarder::forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept
+		{
+			return forward(resolve(serviceName), data);
+		}
+
+		abstraction::data::unique_output_ptr BrokerForwarder::forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept
+		{
+			return forward(resolve(serviceName), std::move(data));
+		}
+
+		// an owned input is handed over, a borrowed one is only lent for the call
+		static abstraction::data::unique_output_ptr transformInput(abstraction::logic::service::IService& service, const abstraction::data::InputData& data,
+			std::shared_ptr<abstraction::data::InputData> owner)
+		{
+			if (owner)
+				return service.transformOwned(std::move(owner));
+			return service.transformBorrowed(data);
+		}
+
+		abstraction::data::unique_output_ptr BrokerForwarder::forward(ServiceHandle service, const abstraction::data::InputData& data) const noexcept
+		{
+			if (!service)
+				return abstraction::data::make_unique_output_ptr(nullptr);
+
+			try
+			{
+				// the caller keeps ownership, nothing is copied by the services that only read their input
+				return service.m_service->transformBorrowed(data);
+			}
+			catch (...)
+			{
+				return abstraction::data::make_unique_output_ptr(nullptr);
+			}
+		}
+
+		abstraction::data::unique_output_ptr BrokerForwarder::forward(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const noexcept
+		{
+			if (!service)
+				return abstraction::data::make_unique_output_ptr(nullptr);
+
+			try
+			{
+				return service.m_service->transformOwned(std::move(data));
+			}
+			catch (...)
+			{
+				return abstraction::data::make_unique_output_ptr(nullptr);
+			}
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> BrokerForwarder::forwardCached(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept
+		{
+			return forwardCached(resolve(serviceName), data);
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> BrokerForwarder::forwardCached(ServiceHandle service, const abstraction::data::InputData& data) const noexcept
+		{
+			// lent to the service for the call only, see forward
+			return forwardCached(service, data, nullptr);
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> BrokerForwarder::forwardCached(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const noexcept
+		{
+			if (!data)
+				return nullptr;
+			const auto& input = *data;
+			return forwardCached(service, input, std::move(data));
+		}
+
+		std::shared_ptr<const abstraction::data::OutputData> BrokerForwarder::forwardCached(ServiceHandle service, const abstraction::data::InputData& data,
+			std::shared_ptr<abstraction::data::InputData> owner) const noexcept
+		{
+			if (!service)
+				return nullptr;
+
+			auto* s = service.m_service;
+			std::string key;
+			std::shared_ptr<const abstraction::data::OutputData> result;
+			try
+			{
+				if (m_cache.isEnabled() && s->isCacheable())
+				{
+					// the service name keeps the keys of different services apart
+					key = s->getName();
+					key += '\0';
+					if (!s->makeCacheKey(data, key))
+						key.clear();
+				}
+				if (key.empty())
+					return abstraction::data::make_shared_output_ptr(transformInput(*s, data, std::move(owner)));
+
+				if (auto hit = m_cache.find(key))
+					return hit;
+
+				result = abstraction::data::make_shared_output_ptr(transformInput(*s, data, std::move(owner)));
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+
+			try
+			{
+				if (result)
+					m_cache.insert(key, result, key.size() + s->getResultSize(*result));
+			}
+			catch (...)
+			{
+				// the result is still good, it only stays out of the cache
+			}
+			return result;
+		}
+
+		abstraction::data::OutputBatch BrokerForwarder::forwardBatch(const std::string& serviceName, const abstraction::data::InputBatch& data) const noexcept
+		{
+			return forwardBatch(resolve(serviceName), data);
+		}
+
+		abstraction::data::OutputBatch BrokerForwarder::forwardBatch(ServiceHandle service, const abstraction::data::InputBatch& data) const noexcept
+		{
+			abstraction::data::OutputBatch out;
+			try
+			{
+				if (service)
+					service.m_service->transformBatch(data, out);
+			}
+			catch (...)
+			{
+				// the results made before the failure stay, the others are null
+			}
+
+			try
+			{
+				out.reserve(data.size());
+				while (out.size() < data.size())
+					out.push_back(abstraction::data::make_unique_output_ptr(nullptr));
+			}
+			catch (...)
+			{
+				// out of memory for the null results, the caller gets the ones made
+			}
+			return out;
+		}
+
+		std::shared_ptr<WorkerPool> BrokerForwarder::getWorkerPool() const
+		{
+			std::lock_guard<std::mutex> lock{ m_workersMutex };
+			if (!m_workers)
+				m_workers = std::make_shared<WorkerPool>(m_workerThreads);
+			return m_workers;
+		}
+
+		void BrokerForwarder::setWorkerThreads(unsigned threads)
+		{
+			std::shared_ptr<WorkerPool> old;
+			{
+				std::lock_guard<std::mutex> lock{ m_workersMutex };
+				m_workerThreads = threads;
+				old = std::move(m_workers);
+			}
+			// the old pool drains its queue and joins on a thread of its own, the caller may be one of its workers
+			if (old)
+				std::thread{ [old = std::move(old)]() mutable { old.reset(); } }.detach();
+		}
+
+		std::future<abstraction::data::unique_output_ptr> BrokerForwarder::forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const
+		{
+			return forwardAsync(resolve(serviceName), std::move(data));
+		}
+
+		std::future<abstraction::data::unique_output_ptr> BrokerForwarder::forwardAsync(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const
+		{
+			// std::function needs a copyable target
+			auto task = std::make_shared<std::packaged_task<abstraction::data::unique_output_ptr()>>([service, data]() {
+				if (!service)
+					return abstraction::data::make_unique_output_ptr(nullptr);
+				return service.m_service->transformOwned(data);
+			});
+			auto result = task->get_future();
+			getWorkerPool()->post([task]() { (*task)(); });
+			return result;
+		}
+
+		void BrokerForwarder::forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data, std::function<void(abstraction::data::unique_output_ptr)> done) const
+		{
+			forwardAsync(resolve(serviceName), std::move(data), std::move(done));
+		}
+
+		void BrokerForwarder::forwardAsync(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data, std::function<void(abstraction::data::unique_output_ptr)> done) const
+		{
+			getWorkerPool()->post([service, data, done]() {
+				auto result = abstraction::data::make_unique_output_ptr(nullptr);
+				try
+				{
+					if (service)
+						result = service.m_service->transformOwned(data);
+				}
+				catch (...)
+				{
+				}
+				done(std::move(result));
+			});
+		}
+
+		struct BrokerHandler::Instance
+		{
+			explicit Instance(std::function<std::shared_ptr<abstraction::logic::service::IService>()> factory) : service{ std::move(factory) } {}
+
+			LazyService service;
+			std::atomic<size_t> outstanding{};
+			std::atomic<size_t> requests{};
+		};
+
+		struct BrokerHandler::Group
+		{
+			BalancePolicy policy{ BalancePolicy::RoundRobin };
+			KeyFunction key;
+			std::vector<std::shared_ptr<Instance>> instances;
+			std::shared_ptr<std::atomic<size_t>> next;	// round robin position, shared by the copies of the group
+		};
+
+		struct BrokerHandler::Registry
+		{
+			std::unordered_map<std::string, Group> groups;
+		};
+
+		BrokerHandler::BrokerHandler(unsigned tokenizerInstances) : m_registry{ std::make_shared<Registry>() }
+		{
+			service_system::profiler::ScopedPhase phase{ "BrokerHandler" };
+
+			// each built when a request first lands on it
+			for (unsigned i = 0; i < (std::max)(1u, tokenizerInstances); ++i)
+			{
+				registerService("tokenizer", []() -> std::shared_ptr<abstraction::logic::service::IService>
+				{
+					service_system::profiler::ScopedPhase phase{ "BrokerHandler tokenizer" };
+					return std::make_shared<service_system::tokenizer::logic::service::TokenizerService>();
+				});
+			}
+			// inputs differ a lot in size, a long one should not hold up the ones queued behind it
+			setPolicy("tokenizer", BalancePolicy::LeastOutstanding);
+		}
+
+		bool BrokerHandler::registerService(std::shared_ptr<abstraction::logic::service::IService> s) noexcept
+		{
+			if (!s)
+				return false;
+
+			try
+			{
+				const auto name = s->getName();
+				if (!registerService(name, [s]() { return s; }))
+					return false;
+
+				// already built, so asking it for the keys costs nothing
+				std::lock_guard<std::mutex> lock{ m_writer };
+				const auto& group = m_registry->groups.at(name);
+				if (group.key)
+					return true;
+
+				auto registry = std::make_shared<Registry>(*m_registry);
+				registry->groups[name].key = [s](const abstraction::data::InputData& d, std::string& key) { return s->makeCacheKey(d, key); };
+				std::atomic_store(&m_registry, std::shared_ptr<const Registry>{ std::move(registry) });
+				return true;
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		bool BrokerHandler::registerService(const std::string& serviceName, std::function<std::shared_ptr<abstraction::logic::service::IService>()> factory) noexcept
+		{
+			if (!factory)
+				return false;
+
+			try
+			{
+				std::lock_guard<std::mutex> lock{ m_writer };
+
+				auto registry = std::make_shared<Registry>(*m_registry);
+				auto& group = registry->groups[serviceName];
+				if (!group.next)
+					group.next = std::make_shared<std::atomic<size_t>>(0);
+				group.instances.push_back(std::make_shared<Instance>(std::move(factory)));
+				std::atomic_store(&m_registry, std::shared_ptr<const Registry>{ std::move(registry) });
+				return true;
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		bool BrokerHandler::setPolicy(const std::string& serviceName, BalancePolicy policy, KeyFunction key) noexcept
+		{
+			try
+			{
+				std::lock_guard<std::mutex> lock{ m_writer };
+
+				if (!m_registry->groups.count(serviceName))
+					return false;
+
+				auto registry = std::make_shared<Registry>(*m_registry);
+				auto& group = registry->groups[serviceName];
+				group.policy = policy;
+				if (key)
+					group.key = std::move(key);
+				std::atomic_store(&m_registry, std::shared_ptr<const Registry>{ std::move(registry) });
+				return true;
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		BrokerHandler::Instance& BrokerHandler::selectInstance(const Group& group, const abstraction::data::InputData& data)
+		{
+			const auto& instances = group.instances;
+			const auto n = instances.size();
+
+			if (group.policy == BalancePolicy::KeyAffinity && group.key)
+			{
+				thread_local std::string key;
+				key.clear();
+				if (group.key(data, key))
+					return *instances[std::hash<std::string>{}(key) % n];
+			}
+
+			const auto start = group.next->fetch_add(1, std::memory_order_relaxed) % n;
+			if (group.policy != BalancePolicy::LeastOutstanding)
+				return *instances[start];
+
+			// scanned from a rotating start, so that idle instances share the requests
+			auto best = start;
+			for (size_t i = 1; i < n; ++i)
+			{
+				const auto j = (start + i) % n;
+				if (instances[j]->outstanding.load(std::memory_order_relaxed) < instances[best]->outstanding.load(std::memory_order_relaxed))
+					best = j;
+			}
+			return *instances[best];
+		}
+
+		std::shared_ptr<abstraction::logic::service::IService> BrokerHandler::getService(const std::string& serviceName) const noexcept
+		{
+			const auto registry = std::atomic_load(&m_registry);
+
+			auto ptr = registry->groups.find(serviceName);
+			if (ptr == registry->groups.cend())
+				return nullptr;
+
+			try
+			{
+				return ptr->second.instances.front()->service.get();
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+		}
+
+		abstraction::data::unique_output_ptr BrokerHandler::forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept
+		{
+			return forward(serviceName, data, nullptr);
+		}
+
+		abstraction::data::unique_output_ptr BrokerHandler::forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept
+		{
+			if (!data)
+				return abstraction::data::make_unique_output_ptr(nullptr);
+
+			const auto& input = *data;
+			return forward(serviceName, input, std::move(data));
+		}
+
+		abstraction::data::unique_output_ptr BrokerHandler::forward(const std::string& serviceName, const abstraction::data::InputData& data,
+			std::shared_ptr<abstraction::data::InputData> owner) const noexcept
+		{
+			// the snapshot keeps the instance alive for the call
+			const auto registry = std::atomic_load(&m_registry);
+
+			auto ptr = registry->groups.find(serviceName);
+			if (ptr == registry->groups.cend())
+				return abstraction::data::make_unique_output_ptr(nullptr);
+
+			try
+			{
+				auto& instance = selectInstance(ptr->second, data);
+				++instance.requests;
+				++instance.outstanding;
+				struct Done
+				{
+					std::atomic<size_t>& outstanding;
+					~Done() { --outstanding; }
+				} done{ instance.outstanding };
+
+				const auto service = instance.service.get();
+				if (service)
+					return transformInput(*service, data, std::move(owner));
+			}
+			catch (...)
+			{
+			}
+			return abstraction::data::make_unique_output_ptr(nullptr);
+		}
+
+		std::vector<BrokerHandler::InstanceLoad> BrokerHandler::getLoad(const std::string& serviceName) const
+		{
+			const auto registry = std::atomic_load(&m_registry);
+
+			std::vector<InstanceLoad> load;
+			auto ptr = registry->groups.find(serviceName);
+			if (ptr != registry->groups.cend())
+			{
+				for (const auto& instance : ptr->second.instances)
+					load.push_back(InstanceLoad{ instance->outstanding.load(), instance->requests.load() });
+			}
+			return load;
+		}
+	}
+
+	namespace yellow_page
+	{
+		BrokerDiscoverer::BrokerDiscoverer() : m_registry{ std::make_shared<Registry>() }
+		{
+			service_system::profiler::ScopedPhase phase{ "BrokerDiscoverer" };
+		}
+
+		bool BrokerDiscoverer::registerService(RegisteredServiceType serviceType, std::unique_ptr<abstraction::logic::service::IService> s) noexcept
+		{
+			if (!s)
+				return false;
+
+			try
+			{
+				std::lock_guard<std::mutex> lock{ m_writer };
+
+				const auto name = s->getName();
+				if (m_registry->byName.count(name))
+					return false;
+
+				auto registry = std::make_shared<Registry>(*m_registry);
+				registry->byName.emplace(name, std::move(s));
+				registry->byType[serviceType].push_back(name);
+				std::atomic_store(&m_registry, std::shared_ptr<const Registry>{ std::move(registry) });
+				return true;
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		std::vector<std::string> BrokerDiscoverer::getService(RegisteredServiceType serviceType) const
+		{
+			const auto registry = std::atomic_load(&m_registry);
+
+			auto ptr = registry->byType.find(serviceType);
+			if (ptr != registry->byType.cend())
+				return ptr->second;
+			return {};
+		}
+
+		std::shared_ptr<abstraction::logic::service::IService> BrokerDiscoverer::findService(const std::string& serviceName) const noexcept
+		{
+			const auto registry = std::atomic_load(&m_registry);
+
+			auto ptr = registry->byName.find(serviceName);
+			if (ptr != registry->byName.cend())
+				return ptr->second;
+			return nullptr;
+		}
+
+		std::shared_ptr<abstraction::data::OutputData> BrokerDiscoverer::forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept
+		{
+			auto service = findService(serviceName);
+			if (!service)
+				return nullptr;
+
+			try
+			{
+				// lent to the service for the call only, see BrokerForwarder::forward
+				return abstraction::data::make_shared_output_ptr(service->transformBorrowed(data));
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+		}
+
+		std::shared_ptr<abstraction::data::OutputData> BrokerDiscoverer::forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept
+		{
+			auto service = findService(serviceName);
+			if (!service)
+				return nullptr;
+
+			try
+			{
+				return abstraction::data::make_shared_output_ptr(service->transformOwned(std::move(data)));
+			}
+			catch (...)
+			{
+				return nullptr;
+			}
+		}
+
+		std::future<std::shared_ptr<abstraction::data::OutputData>> BrokerDiscoverer::forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const
+		{
+			// the task holds the service, which stays alive even if it is replaced in the meantime
+			auto service = findService(serviceName);
+			auto task = std::make_shared<std::packaged_task<std::shared_ptr<abstraction::data::OutputData>()>>([service, data]() {
+				if (!service)
+					return std::shared_ptr<abstraction::data::OutputData>{};
+				return abstraction::data::make_shared_output_ptr(service->transformOwned(data));
+			});
+			auto result = task->get_future();
+			white_page::BrokerForwarder::getInstance().getWorkerPool()->post([task]() { (*task)(); });
+			return result;
+		}
+
+		void BrokerDiscoverer::forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data, std::function<void(std::shared_ptr<abstraction::data::OutputData>)> done) const
+		{
+			auto service = findService(serviceName);
+			white_page::BrokerForwarder::getInstance().getWorkerPool()->post([service, data, done]() {
+				std::shared_ptr<abstraction::data::OutputData> result;
+				try
+				{
+					if (service)
+						result = abstraction::data::make_shared_output_ptr(service->transformOwned(data));
+				}
+				catch (...)
+				{
+				}
+				done(std::move(result));
+			});
+		}
+	}
+
+#ifdef CLOCK_REMOTE_SERVICES
+	namespace remote
+	{
+		const wchar_t* const serviceHostSwitch = L"--service-host";
+
+		// one direction of the shared mapping, written by one process and released by the other in the same order.
+		// Offsets count every byte ever allocated, a payload is contiguous: one that would wrap starts over at the
+		// beginning and the bytes it skipped are released with it
+		class SharedRing
+		{
+		public:
+			struct Header
+			{
+				std::atomic<uint64_t> head;		// moved by the producer
+				std::atomic<uint64_t> tail;		// moved by the consumer
+			};
+
+			SharedRing() = default;
+			SharedRing(Header* header, char* bytes, uint64_t capacity) : m_header{ header }, m_bytes{ bytes }, m_capacity{ capacity } {}
+
+			// false when the ring has no room for size bytes
+			bool allocate(uint64_t size, uint64_t& offset)
+			{
+				const auto head = m_header->head.load(std::memory_order_relaxed);
+				const auto tail = m_header->tail.load(std::memory_order_acquire);
+
+				auto start = head;
+				const auto position = head % m_capacity;
+				if (position + size > m_capacity)
+					start += m_capacity - position;
+				if (size > m_capacity || start + size - tail > m_capacity)
+					return false;
+
+				m_header->head.store(start + size, std::memory_order_relaxed);
+				offset = start;
+				return true;
+			}
+
+			char* at(uint64_t offset) const { return m_bytes + offset % m_capacity; }
+			// whether a frame from the other process points inside the ring
+			bool contains(uint64_t offset, uint64_t size) const { return size <= m_capacity && offset % m_capacity + size <= m_capacity; }
+			void release(uint64_t offset, uint64_t size) { m_header->tail.store(offset + size, std::memory_order_release); }
+
+		private:
+			Header* m_header{};
+			char* m_bytes{};
+			uint64_t m_capacity{};
+		};
+
+		// the headers of both rings, then the request bytes, then the response bytes
+		static const size_t ringHeaderBytes = 64;
+		// largest payload sent through the socket, a larger inline frame is taken for a broken peer
+		static const uint64_t maxInlineBytes = uint64_t{ 256 } << 20;
+
+		static size_t getMappingSize(size_t ringBytes)
+		{
+			return 2 * ringHeaderBytes + 2 * ringBytes;
+		}
+
+		static SharedRing getRequestRing(void* view, size_t ringBytes)
+		{
+			auto* base = static_cast<char*>(view);
+			return SharedRing{ reinterpret_cast<SharedRing::Header*>(base), base + 2 * ringHeaderBytes, ringBytes };
+		}
+
+		static SharedRing getResponseRing(void* view, size_t ringBytes)
+		{
+			auto* base = static_cast<char*>(view);
+			return SharedRing{ reinterpret_cast<SharedRing::Header*>(base + ringHeaderBytes), base + 2 * ringHeaderBytes + ringBytes, ringBytes };
+		}
+
+		// sent over the socket for each request and response, followed by the payload when it is inline
+		struct Frame
+		{
+			enum Flags : uint32_t
+			{
+				Inline = 1,
+				Failed = 2,		// the host had no result
+			};
+
+			uint64_t id;
+			uint64_t offset;	// in the ring of that direction
+			uint64_t size;
+			uint32_t flags;
+			uint32_t reserved;
+		};
+
+		static void startWinsock()
+		{
+			struct Winsock
+			{
+				Winsock() : ok{ WSAStartup(MAKEWORD(2, 2), &data) == 0 } {}
+				~Winsock()
+				{
+					if (ok)
+						WSACleanup();
+				}
+				WSADATA data;
+				const bool ok;
+			};
+			static Winsock winsock;
+			if (!winsock.ok)
+				throw abstraction::data::exception::Exception("WSAStartup failed");
+		}
+
+		static void throwRemoteError(const char* what, long error)
+		{
+			std::ostringstream oss;
+			oss << what << " failed with error " << error;
+			throw abstraction::data::exception::Exception(oss.str());
+		}
+
+		static bool sendAll(SOCKET s, const char* data, size_t size)
+		{
+			while (size)
+			{
+				const int n = send(s, data, static_cast<int>(std::min<size_t>(size, INT_MAX)), 0);
+				if (n <= 0)
+					return false;
+				data += n;
+				size -= n;
+			}
+			return true;
+		}
+
+		static bool receiveAll(SOCKET s, char* data, size_t size)
+		{
+			while (size)
+			{
+				const int n = recv(s, data, static_cast<int>(std::min<size_t>(size, INT_MAX)), 0);
+				if (n <= 0)
+					return false;
+				data += n;
+				size -= n;
+			}
+			return true;
+		}
+
+		// both processes derive the socket path and the mapping name from the same key
+		static std::string getSocketPath(const std::string& key)
+		{
+			char temp[MAX_PATH + 1];
+			const auto n = GetTempPathA(MAX_PATH + 1, temp);
+			if (n == 0 || n > MAX_PATH)
+				throwRemoteError("GetTempPathA", GetLastError());
+			return std::string(temp, n) + key + ".sock";
+		}
+
+		static std::wstring getMappingName(const std::string& key)
+		{
+			return L"Local\\" + std::wstring(key.begin(), key.end());
+		}
+
+		static sockaddr_un makeAddress(const std::string& path)
+		{
+			sockaddr_un address{};
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path))
+				throw abstraction::data::exception::Exception("socket path too long: " + path);
+			std::copy(path.begin(), path.end(), address.sun_path);
+			return address;
+		}
 
-			void subscribe(const std::string& eventName, std::unique_ptr<abstraction::boundary::proxy::Observer> observer);
-			void unsubscribe(const std::string& eventName, const std::string& observerName);
-			void notify(const string& eventName, std::shared_ptr<abstraction::data::Data>) const;
+		class RemoteService::RemoteServiceImpl
+		{
+		public:
+			RemoteServiceImpl(const std::string& serviceName, std::shared_ptr<const abstraction::logic::service::IServiceCodec> codec, RemoteOptions options)
+				: m_name{ serviceName }, m_codec{ std::move(codec) }, m_options{ options }
+			{
+			}
 
-			void registerEvent(const string& eventName);
+			const std::string& getName() const noexcept { return m_name; }
+			abstraction::data::unique_output_ptr transform(const abstraction::data::InputData& d);
+			Statistics getStatistics() const;
 
 		private:
-			using ObserversList = std::unordered_map<string, unique_ptr<abstraction::boundary::proxy::Observer>>;
-			using Observers = std::unordered_map<string, ObserversList>;
-
-			Observers m_observers;
+			class Connection;
+
+			// a live host, started again when the last one is broken; null if it cannot start
+			std::shared_ptr<Connection> connect();
+
+			const std::string m_name;
+			const std::shared_ptr<const abstraction::logic::service::IServiceCodec> m_codec;
+			const RemoteOptions m_options;
+
+			std::mutex m_mutex;
+			std::shared_ptr<Connection> m_connection;
+			std::shared_future<std::shared_ptr<Connection>> m_starting;	// valid while a host starts
+
+			std::atomic<size_t> m_calls{};
+			std::atomic<size_t> m_failures{};
+			std::atomic<size_t> m_timeouts{};
+			std::atomic<size_t> m_starts{};
+			std::atomic<size_t> m_sharedBytes{};
+			std::atomic<size_t> m_inlineBytes{};
+			std::atomic<uint64_t> m_nanoseconds{};
 		};
 
-		Publisher::Publisher()
+		// one host process: its socket, its shared mapping and the thread receiving its responses
+		class RemoteService::RemoteServiceImpl::Connection
 		{
-			impl = std::make_unique<PublisherImpl>();
-		}
-		void Publisher::subscribe(const string& eventName, unique_ptr<abstraction::boundary::proxy::Observer> observer)
+		public:
+			Connection(RemoteServiceImpl& owner);
+			~Connection();
+
+			// null if the host has no result, the connection is then broken unless the input was not encodable
+			abstraction::data::unique_output_ptr call(const abstraction::data::InputData& d);
+			bool isBroken() const noexcept { return m_broken; }
+
+		private:
+			void open();
+			void close();
+			void receive();
+			// true when the host is gone or the connection closes, false for a frame out of bounds
+			bool receiveFrames();
+			// kills the host, every call in flight gives a null result
+			void breakDown();
+			void failPending();
+
+			RemoteServiceImpl& m_owner;
+			std::string m_key;
+			HANDLE m_process{};
+			HANDLE m_mapping{};
+			void* m_view{};
+			SOCKET m_socket{ INVALID_SOCKET };
+			SharedRing m_requests;
+			SharedRing m_responses;
+
+			std::atomic<bool> m_broken{};
+			std::mutex m_sendMutex;		// one request written at a time
+			uint64_t m_nextId{};
+			std::vector<char> m_outbound;
+
+			std::mutex m_pendingMutex;
+			std::unordered_map<uint64_t, std::promise<abstraction::data::unique_output_ptr>> m_pending;
+
+			std::thread m_receiver;
+		};
+
+		RemoteService::RemoteServiceImpl::Connection::Connection(RemoteServiceImpl& owner) : m_owner{ owner }
 		{
-			impl->subscribe(eventName, std::move(observer));
+			try
+			{
+				open();
+			}
+			catch (...)
+			{
+				close();
+				throw;
+			}
 		}
-		void Publisher::unsubscribe(const string& eventName, const string& observerName)
+
+		RemoteService::RemoteServiceImpl::Connection::~Connection()
 		{
-			return impl->unsubscribe(eventName, observerName);
+			close();
 		}
-		Publisher::~Publisher()
+
+		void RemoteService::RemoteServiceImpl::Connection::open()
 		{
-			// std::unique_ptr requires a definition of the destructor instead
-			// of using the default because the destructor must appear in a scope
-			// in which the complete definition of the template argument for
-			// std::unique_ptr is known
+			static std::atomic<unsigned> counter{ 0 };
+			m_key = "clock-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(counter++);
+
+			startWinsock();
+
+			const auto ringBytes = m_owner.m_options.ringBytes;
+			const auto mappingSize = static_cast<uint64_t>(getMappingSize(ringBytes));
+			m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize & 0xFFFFFFFF), getMappingName(m_key).c_str());
+			if (!m_mapping)
+				throwRemoteError("CreateFileMappingW", GetLastError());
+			// someone else's mapping under our name would hand us rings that are not empty
+			if (GetLastError() == ERROR_ALREADY_EXISTS)
+				throw abstraction::data::exception::Exception("shared memory " + m_key + " already exists");
+			m_view = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<size_t>(mappingSize));
+			if (!m_view)
+				throwRemoteError("MapViewOfFile", GetLastError());
+			// a new mapping is zero filled, both rings start empty
+			m_requests = getRequestRing(m_view, ringBytes);
+			m_responses = getResponseRing(m_view, ringBytes);
+
+			const auto path = getSocketPath(m_key);
+			const auto address = makeAddress(path);
+			SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (listener == INVALID_SOCKET)
+				throwRemoteError("socket", WSAGetLastError());
+			std::unique_ptr<SOCKET, void(*)(SOCKET*)> listenerGuard{ &listener, [](SOCKET* s) { closesocket(*s); } };
+			DeleteFileA(path.c_str());
+			if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR)
+				throwRemoteError("bind", WSAGetLastError());
+			std::unique_ptr<const char, BOOL(WINAPI*)(const char*)> pathGuard{ path.c_str(), &DeleteFileA };
+			if (listen(listener, 1) == SOCKET_ERROR)
+				throwRemoteError("listen", WSAGetLastError());
+
+			std::wstring program(32768, L'\0');
+			program.resize(GetModuleFileNameW(nullptr, &program[0], static_cast<DWORD>(program.size())));
+			if (program.empty())
+				throwRemoteError("GetModuleFileNameW", GetLastError());
+			const auto& name = m_owner.m_name;
+			std::wstring commandLine = L"\"" + program + L"\" " + serviceHostSwitch + L" " + std::wstring(name.begin(), name.end()) + L" " + std::wstring(m_key.begin(), m_key.end()) + L" " + std::to_wstring(ringBytes);
+
+			STARTUPINFOW startup{};
+			startup.cb = sizeof(startup);
+			PROCESS_INFORMATION process{};
+			if (!CreateProcessW(program.c_str(), &commandLine[0], nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &startup, &process))
+				throwRemoteError("CreateProcessW", GetLastError());
+			CloseHandle(process.hThread);
+			m_process = process.hProcess;
+
+			// waits in slices, a host that cannot run the service exits before connecting
+			const auto deadline = std::chrono::steady_clock::now() + m_owner.m_options.startTimeout;
+			for (;;)
+			{
+				fd_set ready;
+				FD_ZERO(&ready);
+				FD_SET(listener, &ready);
+				timeval wait{ 0, 50 * 1000 };
+				const int n = select(static_cast<int>(listener + 1), &ready, nullptr, nullptr, &wait);
+				if (n == SOCKET_ERROR)
+					throwRemoteError("select", WSAGetLastError());
+				if (n > 0)
+					break;
+				if (WaitForSingleObject(m_process, 0) == WAIT_OBJECT_0)
+					throw abstraction::data::exception::Exception("service host " + name + " exited before connecting");
+				if (std::chrono::steady_clock::now() >= deadline)
+					throw abstraction::data::exception::Exception("service host " + name + " did not connect in time");
+			}
+			m_socket = accept(listener, nullptr, nullptr);
+			if (m_socket == INVALID_SOCKET)
+				throwRemoteError("accept", WSAGetLastError());
+
+			m_receiver = std::thread{ &Connection::receive, this };
 		}
-		void Publisher::notify(const string& eventName, shared_ptr<abstraction::data::Data> data) const
+
+		void RemoteService::RemoteServiceImpl::Connection::close()
 		{
-			impl->notify(eventName, data);
+			// a host that is not already gone exits once its socket closes, it is killed if it does not
+			if (m_socket != INVALID_SOCKET)
+				shutdown(m_socket, SD_BOTH);
+			if (m_receiver.joinable())
+				m_receiver.join();
+			if (m_process)
+			{
+				if (WaitForSingleObject(m_process, 1000) != WAIT_OBJECT_0)
+					TerminateProcess(m_process, 1);
+				CloseHandle(m_process);
+				m_process = nullptr;
+			}
+			if (m_socket != INVALID_SOCKET)
+			{
+				closesocket(m_socket);
+				m_socket = INVALID_SOCKET;
+			}
+			if (m_view)
+			{
+				UnmapViewOfFile(m_view);
+				m_view = nullptr;
+			}
+			if (m_mapping)
+			{
+				CloseHandle(m_mapping);
+				m_mapping = nullptr;
+			}
+			failPending();
 		}
-		void Publisher::registerEvent(const string& eventName)
+
+		void RemoteService::RemoteServiceImpl::Connection::breakDown()
 		{
-			impl->registerEvent(eventName);
+			m_broken = true;
+			if (m_process)
+				TerminateProcess(m_process, 1);
+			if (m_socket != INVALID_SOCKET)
+				shutdown(m_socket, SD_BOTH);
+			failPending();
 		}
 
-		void Publisher::PublisherImpl::subscribe(const string& eventName, std::unique_ptr<abstraction::boundary::proxy::Observer> observer)
+		void RemoteService::RemoteServiceImpl::Connection::failPending()
 		{
-			auto ptr = m_observers.find(eventName);
-			if (ptr == std::end(m_observers))
-			{
-				std::ostringstream oss;
-				oss << "Event with name '" << eventName << "' not supported";
-				throw abstraction::data::exception::Exception(oss.str());
-			}
-			else
+			std::unordered_map<uint64_t, std::promise<abstraction::data::unique_output_ptr>> pending;
 			{
-				auto iter = m_observers[eventName].insert(std::make_pair(observer->getName(), std::move(observer)));
-				if (!iter.second)
-				{
-					std::ostringstream oss;
-					oss << "Observer '" << observer->getName() << "' is already registered";
-					throw abstraction::data::exception::Exception(oss.str());
-				}
+				std::lock_guard<std::mutex> lock{ m_pendingMutex };
+				pending.swap(m_pending);
 			}
+			for (auto& p : pending)
+				p.second.set_value(abstraction::data::make_unique_output_ptr(nullptr));
 		}
 
-		void Publisher::PublisherImpl::unsubscribe(const string& eventName, const string& observerName)
+		abstraction::data::unique_output_ptr RemoteService::RemoteServiceImpl::Connection::call(const abstraction::data::InputData& d)
 		{
-			auto count = m_observers.count(eventName);
-			if (count)
+			size_t size;
+			if (!m_owner.m_codec->measureInput(d, size))
+				return abstraction::data::make_unique_output_ptr(nullptr);
+
+			std::promise<abstraction::data::unique_output_ptr> promise;
+			auto result = promise.get_future();
 			{
-				auto found = m_observers[eventName].erase(observerName);
-				if (!found)
+				std::lock_guard<std::mutex> lock{ m_sendMutex };
+				if (m_broken)
+					return abstraction::data::make_unique_output_ptr(nullptr);
+
+				Frame frame{ m_nextId++, 0, size, 0, 0 };
 				{
-					std::ostringstream oss;
-					oss << "Observer '" << observerName << "' not found registered";
-					throw abstraction::data::exception::Exception(oss.str());
+					std::lock_guard<std::mutex> pendingLock{ m_pendingMutex };
+					m_pending.emplace(frame.id, std::move(promise));
+				}
+
+				bool sent;
+				if (size && m_requests.allocate(size, frame.offset))
+				{
+					m_owner.m_codec->writeInput(d, m_requests.at(frame.offset));
+					sent = sendAll(m_socket, reinterpret_cast<const char*>(&frame), sizeof(frame));
+					m_owner.m_sharedBytes += size;
+				}
+				else if (size > maxInlineBytes)
+				{
+					// the host would take it for a broken peer
+					std::lock_guard<std::mutex> pendingLock{ m_pendingMutex };
+					m_pending.erase(frame.id);
+					return abstraction::data::make_unique_output_ptr(nullptr);
+				}
+				else
+				{
+					frame.flags = Frame::Inline;
+					m_outbound.resize(size);
+					if (size)
+						m_owner.m_codec->writeInput(d, m_outbound.data());
+					sent = sendAll(m_socket, reinterpret_cast<const char*>(&frame), sizeof(frame)) && sendAll(m_socket, m_outbound.data(), size);
+					m_owner.m_inlineBytes += size;
 				}
+				if (!sent)
+					breakDown();
 			}
-			else
+
+			if (result.wait_for(m_owner.m_options.callTimeout) != std::future_status::ready)
 			{
-				std::ostringstream oss;
-				oss << "Event with name '" << eventName << "' not supported";
-				throw abstraction::data::exception::Exception(oss.str());
+				++m_owner.m_timeouts;
+				breakDown();
 			}
+			return result.get();
 		}
 
-		void Publisher::PublisherImpl::notify(const string& eventName, shared_ptr<abstraction::data::Data> event_) const
+		void RemoteService::RemoteServiceImpl::Connection::receive()
 		{
-			auto ptr = m_observers.find(eventName);
-			if (ptr != std::end(m_observers))
+			// nothing may escape this thread: a failure of its own or a frame that makes no sense
+			// ends the connection and its host
+			bool closed = false;
+			try
 			{
-				const auto& obsList = ptr->second;
-
-				for (const auto& obs : obsList)
-					obs.second->notify(event_);
+				closed = receiveFrames();
 			}
-			else
+			catch (...)
+			{
+			}
+
+			if (closed)
 			{
-				std::ostringstream oss;
-				oss << "Event with name '" << eventName << "' not supported";
-				throw abstraction::data::exception::Exception(oss.str());
+				m_broken = true;
+				failPending();
 			}
+			else
+				breakDown();
 		}
 
-		void Publisher::PublisherImpl::registerEvent(const string& eventName)
+		bool RemoteService::RemoteServiceImpl::Connection::receiveFrames()
 		{
-			auto i = m_observers.find(eventName);
-			if (i != m_observers.end())
-				throw abstraction::data::exception::Exception{ "Event already registered" };
+			std::vector<char> inbound;
+			Frame frame;
+			while (receiveAll(m_socket, reinterpret_cast<char*>(&frame), sizeof(frame)))
+			{
+				const char* payload;
+				if (frame.flags & Frame::Inline)
+				{
+					if (frame.size > maxInlineBytes)
+						return false;
+					inbound.resize(static_cast<size_t>(frame.size));
+					if (!receiveAll(m_socket, inbound.data(), inbound.size()))
+						return true;
+					payload = inbound.data();
+					m_owner.m_inlineBytes += inbound.size();
+				}
+				else
+				{
+					if (!m_responses.contains(frame.offset, frame.size))
+						return false;
+					payload = m_responses.at(frame.offset);
+					m_owner.m_sharedBytes += static_cast<size_t>(frame.size);
+				}
+
+				auto out = abstraction::data::make_unique_output_ptr(nullptr);
+				if (!(frame.flags & Frame::Failed))
+				{
+					try
+					{
+						out = m_owner.m_codec->readOutput(payload, static_cast<size_t>(frame.size));
+					}
+					catch (...)
+					{
+					}
+				}
+				if (!(frame.flags & Frame::Inline) && frame.size)
+					m_responses.release(frame.offset, frame.size);
 
-			m_observers[eventName] = ObserversList{};
+				std::promise<abstraction::data::unique_output_ptr> promise;
+				{
+					std::lock_guard<std::mutex> lock{ m_pendingMutex };
+					auto p = m_pending.find(frame.id);
+					if (p == m_pending.end())
+						continue;	// the call gave up on it
+					promise = std::move(p->second);
+					m_pending.erase(p);
+				}
+				promise.set_value(std::move(out));
+			}
+			// the host is gone or the connection is closing
+			return true;
 		}
-	}
 
-	namespace tokenizer
-	{
-		namespace logic
+		std::shared_ptr<RemoteService::RemoteServiceImpl::Connection> RemoteService::RemoteServiceImpl::connect()
 		{
-			namespace business
+			// the host starts outside the lock, callers arriving meanwhile wait for that start instead of another
+			std::shared_ptr<Connection> broken;
+			std::promise<std::shared_ptr<Connection>> started;
+			std::shared_future<std::shared_ptr<Connection>> starting;
 			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				if (m_connection && !m_connection->isBroken())
+					return m_connection;
 
-			} // namespace business
+				if (m_starting.valid())
+					starting = m_starting;
+				else
+				{
+					// closed once the lock is released, closing waits for its host to exit
+					broken = std::move(m_connection);
+					m_starting = started.get_future().share();
+				}
+			}
+			if (starting.valid())
+				return starting.get();
 
-			namespace service
+			std::shared_ptr<Connection> connection;
+			try
 			{
-				const std::string TokenizerService::name = "tokenizer";
+				connection = std::make_shared<Connection>(*this);
+				++m_starts;
+			}
+			catch (...)
+			{
+			}
 
-				TokenizerService::~TokenizerService()
-				{
-				}
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				m_connection = connection;
+				m_starting = std::shared_future<std::shared_ptr<Connection>>{};
+			}
+			started.set_value(connection);
+			return connection;
+		}
 
-				abstraction::data::OutputData* TokenizerService::transform(std::shared_ptr<abstraction::data::InputData> d) {
+		abstraction::data::unique_output_ptr RemoteService::RemoteServiceImpl::transform(const abstraction::data::InputData& d)
+		{
+			++m_calls;
+			const auto start = std::chrono::steady_clock::now();
 
-					auto data = dynamic_pointer_cast<data::TokenizerInputData>(d);
-					string ss = data->getData();
-					char token = data->getToken();
-					size_t pos{};
+			auto out = abstraction::data::make_unique_output_ptr(nullptr);
+			if (auto connection = connect())
+				out = connection->call(d);
 
-					while ((pos = ss.find(token)) != std::string::npos)
-						ss.replace(pos, 1, " ");
+			if (out)
+				m_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			else
+				++m_failures;
+			return out;
+		}
 
-					std::istringstream iss{ ss };
-					vector<string>tokens_{};
-					tokens_.assign(std::istream_iterator<string>{iss}, std::istream_iterator<string>{});
+		RemoteService::Statistics RemoteService::RemoteServiceImpl::getStatistics() const
+		{
+			return Statistics{ m_calls, m_failures, m_timeouts, m_starts, m_sharedBytes, m_inlineBytes, m_nanoseconds };
+		}
 
-					for (auto& i : tokens_)
-						std::transform(i.begin(), i.end(), i.begin(), ::toupper);
+		RemoteService::RemoteService(const std::string& serviceName, std::shared_ptr<const abstraction::logic::service::IServiceCodec> codec, RemoteOptions options)
+			: pimpl_{ std::make_unique<RemoteServiceImpl>(serviceName, std::move(codec), options) }
+		{
+		}
 
-					return new data::TokenizerOutputData(tokens_);
-				}
+		RemoteService::~RemoteService()
+		{
+		}
 
-			}
+		std::string RemoteService::getName() const
+		{
+			return pimpl_->getName();
 		}
-	}
-}
 
-namespace broker_system
-{
-	namespace white_page
-	{
-		abstraction::data::OutputData* BrokerForwarder::forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept
+		abstraction::data::OutputData* RemoteService::transform(std::shared_ptr<abstraction::data::InputData> d)
 		{
-			auto ptr = std::find_if(m_services.cbegin(), m_services.cend(), [&serviceName](auto& d)
-				{ return serviceName == d.first; });
-			if (ptr != m_services.cend())
-				return ptr->second->transform(std::make_shared<abstraction::data::InputData>(data));
-			return nullptr;
+			return transformOwned(std::move(d)).release();
 		}
 
-		std::shared_ptr<abstraction::logic::service::IService> BrokerHandler::getService(const std::string& serviceName) const noexcept
+		abstraction::data::unique_output_ptr RemoteService::transformOwned(std::shared_ptr<abstraction::data::InputData> d)
 		{
-			auto ptr = std::find_if(m_services.cbegin(), m_services.cend(), [&serviceName](auto& d)
-				{ return serviceName == d.first; });
-			if (ptr != m_services.cend())
-				return (ptr->second);
-			return nullptr;
+			if (!d)
+				return abstraction::data::make_unique_output_ptr(nullptr);
+			return pimpl_->transform(*d);
 		}
-	}
 
-	namespace yellow_page_broker
-	{
+		abstraction::data::unique_output_ptr RemoteService::transformBorrowed(const abstraction::data::InputData& d)
+		{
+			return pimpl_->transform(d);
+		}
+
+		RemoteService::Statistics RemoteService::getStatistics() const
+		{
+			return pimpl_->getStatistics();
+		}
+
+		// the services a host process can run
+		static bool makeHostedService(const std::string& name, std::unique_ptr<abstraction::logic::service::IService>& service, std::unique_ptr<abstraction::logic::service::IServiceCodec>& codec)
+		{
+			if (name == "tokenizer")
+			{
+				service = std::make_unique<service_system::tokenizer::logic::service::TokenizerService>();
+				codec = std::make_unique<service_system::tokenizer::logic::service::TokenizerCodec>();
+				return true;
+			}
+			return false;
+		}
+
+		int runServiceHost(const std::wstring& commandLine)
+		{
+			// switch, service name, key, ring bytes
+			std::vector<std::wstring> arguments;
+			std::wistringstream in{ commandLine };
+			std::wstring argument;
+			while (in >> argument)
+				arguments.push_back(argument);
+			if (arguments.size() != 4 || arguments[0] != serviceHostSwitch)
+				return 2;
+
+			std::unique_ptr<abstraction::logic::service::IService> service;
+			std::unique_ptr<abstraction::logic::service::IServiceCodec> codec;
+			if (!makeHostedService(std::string(arguments[1].begin(), arguments[1].end()), service, codec))
+				return 2;
+			const std::string key(arguments[2].begin(), arguments[2].end());
+
+			try
+			{
+				const auto ringBytes = static_cast<size_t>(std::stoull(arguments[3]));
+				startWinsock();
+
+				HANDLE mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, getMappingName(key).c_str());
+				if (!mapping)
+					throwRemoteError("OpenFileMappingW", GetLastError());
+				std::unique_ptr<void, decltype(&CloseHandle)> mappingGuard{ mapping, &CloseHandle };
+				void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, getMappingSize(ringBytes));
+				if (!view)
+					throwRemoteError("MapViewOfFile", GetLastError());
+				std::unique_ptr<void, decltype(&UnmapViewOfFile)> viewGuard{ view, &UnmapViewOfFile };
+				auto requests = getRequestRing(view, ringBytes);
+				auto responses = getResponseRing(view, ringBytes);
+
+				SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (s == INVALID_SOCKET)
+					throwRemoteError("socket", WSAGetLastError());
+				std::unique_ptr<SOCKET, void(*)(SOCKET*)> socketGuard{ &s, [](SOCKET* p) { closesocket(*p); } };
+				const auto address = makeAddress(getSocketPath(key));
+				if (connect(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR)
+					throwRemoteError("connect", WSAGetLastError());
+
+				// one request at a time, until the RemoteService disconnects
+				std::vector<char> inbound;
+				std::vector<char> outbound;
+				Frame frame;
+				while (receiveAll(s, reinterpret_cast<char*>(&frame), sizeof(frame)))
+				{
+					// the ring releases in order, a slot left behind would block every later request
+					struct Release
+					{
+						SharedRing& ring;
+						uint64_t offset;
+						uint64_t size;		// nothing to release while 0
+						void now()
+						{
+							if (size)
+								ring.release(offset, size);
+							size = 0;
+						}
+						~Release() { now(); }
+					} release{ requests, frame.offset, 0 };
+
+					const char* payload;
+					if (frame.flags & Frame::Inline)
+					{
+						if (frame.size > maxInlineBytes)
+							break;
+						inbound.resize(static_cast<size_t>(frame.size));
+						if (!receiveAll(s, inbound.data(), inbound.size()))
+							break;
+						payload = inbound.data();
+					}
+					else
+					{
+						if (!requests.contains(frame.offset, frame.size))
+							break;
+						payload = requests.at(frame.offset);
+						release.size = frame.size;
+					}
+
+					auto out = abstraction::data::make_unique_output_ptr(nullptr);
+					try
+					{
+						auto input = codec->readInput(payload, static_cast<size_t>(frame.size));
+						release.now();
+						if (input)
+							out = service->transformOwned(std::move(input));
+					}
+					catch (...)
+					{
+					}
 
+					Frame response{ frame.id, 0, 0, 0, 0 };
+					size_t size = 0;
+					const bool encodable = out && codec->measureOutput(*out, size);
+					bool sent;
+					if (encodable && size && responses.allocate(size, response.offset))
+					{
+						response.size = size;
+						codec->writeOutput(*out, responses.at(response.offset));
+						sent = sendAll(s, reinterpret_cast<const char*>(&response), sizeof(response));
+					}
+					else if (!encodable || size > maxInlineBytes)
+					{
+						response.flags = Frame::Failed;
+						sent = sendAll(s, reinterpret_cast<const char*>(&response), sizeof(response));
+					}
+					else
+					{
+						response.flags = Frame::Inline;
+						response.size = size;
+						outbound.resize(size);
+						if (size)
+							codec->writeOutput(*out, outbound.data());
+						sent = sendAll(s, reinterpret_cast<const char*>(&response), sizeof(response)) && sendAll(s, outbound.data(), size);
+					}
+					if (!sent)
+						break;
+				}
+			}
+			catch (...)
+			{
+				return 1;
+			}
+			return 0;
+		}
 	}
+#endif
 }
 
 namespace app
@@ -260,12 +3646,28 @@ namespace app
 
 					return;
 				}
+				// "h m s", read without a stream so that a tick does not allocate
+				static bool parseTime(const string& time, float (&hms)[3])
+				{
+					const char* p = time.c_str();
+					for (auto& value : hms)
+					{
+						char* end;
+						value = strtof(p, &end);
+						if (end == p)
+							return false;
+						p = end;
+					}
+					return true;
+				}
+
 				void ModelProxy::update(const string& time, bool notif)noexcept {
-					std::istringstream iss{ time };
-					vector<string>tokens_{};
-					tokens_.assign(
-						std::istream_iterator<string>{iss},
-							std::istream_iterator<string>{});
+					float hms[3];
+					if (!parseTime(time, hms))
+						return;
+
+					// all the hands go out together, as one frame
+					m_frame.clear();
 
 					// get the need Hand Rectangle and rotate it.
 					auto h_ptr = find_if(m_data.cbegin(), m_data.cend(), [&](const auto& d) {
@@ -274,11 +3676,9 @@ namespace app
 					if (h_ptr != m_data.cend()) {
 
 						auto r = h_ptr->second;
-						const float fHourAngle = (360.0f / 12) * (stof(tokens_.at(0)));
+						const float fHourAngle = (360.0f / 12) * hms[0];
 
-						if (notif)
-							notify(resultAvailable,
-								make_shared<data_abstraction::ModelOutputData>(r, fHourAngle));
+						m_frame.add(r, fHourAngle);
 					}
 
 					auto m_ptr = find_if(m_data.cbegin(), m_data.cend(), [&](const auto& d) {
@@ -287,11 +3687,9 @@ namespace app
 					if (m_ptr != m_data.cend()) {
 
 						auto r = m_ptr->second;
-						const float fminutesAngle = (360.0f / 60) * (stof(tokens_.at(1)));
+						const float fminutesAngle = (360.0f / 60) * hms[1];
 
-						if (notif)
-							notify(resultAvailable,
-								make_shared<data_abstraction::ModelOutputData>(r, fminutesAngle));
+						m_frame.add(r, fminutesAngle);
 					}
 
 					auto s_ptr = find_if(m_data.cbegin(), m_data.cend(), [&](const auto& d) {
@@ -300,22 +3698,41 @@ namespace app
 					if (s_ptr != m_data.cend()) {
 
 						auto r = s_ptr->second;
-						const float fsecondsAngle = (360.0f / 60) * (stof(tokens_.at(2)));
+						const float fsecondsAngle = (360.0f / 60) * hms[2];
+
+						m_frame.add(r, fsecondsAngle);
+					}
+
+					if (notif)
+					{
+						m_frames.notify(m_frame);
 
-						if (notif)
-							notify(resultAvailable,
-								make_shared<data_abstraction::ModelOutputData>(r, fsecondsAngle));
+						// the shared copy is only made for the observers of the untyped event
+						if (hasObservers(m_resultAvailable))
+							notify(m_resultAvailable, make_shared<data_abstraction::ModelFrameData>(m_frame));
 					}
 				}
 
+				void ModelProxy::subscribe(std::unique_ptr<abstraction::boundary::proxy::channel::Observer<data_abstraction::ModelFrameData>> observer)
+				{
+					m_frames.subscribe(std::move(observer));
+				}
+
+				void ModelProxy::unsubscribe(const std::string& observerName)
+				{
+					m_frames.unsubscribe(observerName);
+				}
+
 				ModelProxy& ModelProxy::getInstance()
 				{
 					static ModelProxy instance;
 					return instance;
 				}
-				ModelProxy::ModelProxy() :/*AdamProxyImpl()*/ m_data{}, m_data_{}{
-					registerEvent(ModelProxy::resultAvailable);
-					registerEvent(ModelProxy::adamError);
+				ModelProxy::ModelProxy() :/*AdamProxyImpl()*/ m_data{}, m_data_{}, m_frames{}, m_frame{ 3 }{
+					service_system::profiler::ScopedPhase phase{ "ModelProxy" };
+
+					m_resultAvailable = registerEvent(ModelProxy::resultAvailable);
+					m_adamError = registerEvent(ModelProxy::adamError);
 
 					m_data["hoursHand"] = data_abstraction::Rectangle(200.0f, 185.0f, 200.0f, 100.0f);
 					m_data["minutesHand"] = data_abstraction::Rectangle(200.0f, 185.0f, 290.0f, 200.0f);
@@ -520,6 +3937,12 @@ namespace app
 				{
 					const char* UserInterface::InputEntered = "Input entered";
 
+					void UserInterface::sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame)
+					{
+						for (const auto& hand : frame)
+							sendOutput(std::make_shared<server_subsystem::data_abstraction::ModelOutputData>(hand));
+					}
+
 					namespace cli
 					{
 						void CustomerInteraction::run()
@@ -530,7 +3953,7 @@ namespace app
 
 							string time{ "10 30 15" };
 
-							notify(InputEntered, 
+							notify(m_inputEntered, 
 									make_shared<data::UserInterfaceIntputData>(
 										data::UserInterfaceIntputData(time, "timer")
 										)
@@ -544,7 +3967,19 @@ namespace app
 							m_os << "CustomerInteraction::sendOutput-> Notifaction arrived at the View Side" << endl;
 							m_os << msg << endl;
 						}
+						void CustomerInteraction::sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame) {
+							for (const auto& hand : frame)
+								hand.getRectangle().Print(m_os) << " new angle: " << hand.getAngle() << endl;
+						}
 						void CustomerInteraction::sendOutput(shared_ptr<abstraction::data::Data>d) {
+							auto frame = dynamic_pointer_cast<server_subsystem::data_abstraction::ModelFrameData>(d);
+
+							if (frame)
+							{
+								sendOutput(*frame);
+								return;
+							}
+
 							auto ptr = dynamic_pointer_cast<server_subsystem::data_abstraction::ModelOutputData>(d);
 
 							if (ptr)
@@ -641,13 +4076,44 @@ namespace app
 						Win::~Win() {
 							m_data.~WinImpl();
 						}
+
+						void Win::notifyTime() {
+							static const string sender = "timer";
+
+							SYSTEMTIME time;
+							GetLocalTime(&time);
+
+							// formatted in place, to_string and operator+ would build temporaries
+							char text[32];
+							const int n = snprintf(text, sizeof(text), "%u %u %u", time.wHour, time.wMinute, time.wSecond);
+							m_time.assign(text, n > 0 ? static_cast<size_t>(n) : 0);
+
+							// an observer may still hold the last input, then it gets a new one
+							if (m_tick && m_tick.use_count() == 1)
+								m_tick->reset(m_time, sender);
+							else
+								m_tick = make_shared<data::UserInterfaceIntputData>(m_time, sender);
+
+							notify(m_inputEntered, m_tick);
+						}
 						void Win::sendInput() {
 
 						}
 						void Win::sendOutput(const char* msg) {
 
+						}
+						void Win::sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame) {
+							OnFrameRender(frame);
 						}
 						void Win::sendOutput(std::shared_ptr<abstraction::data::Data>d) {
+							auto frame = dynamic_pointer_cast<server_subsystem::data_abstraction::ModelFrameData>(d);
+
+							if (frame)
+							{
+								sendOutput(*frame);
+								return;
+							}
+
 							auto data = dynamic_pointer_cast<server_subsystem::data_abstraction::ModelOutputData>(d);
 
 							if (data)
@@ -689,17 +4155,6 @@ namespace app
 									)));
 								if (pApp)
 								{
-
-									SYSTEMTIME time;
-									GetLocalTime(&time);
-
-									auto hours = time.wHour;
-									auto minuts = time.wMinute;
-									auto seconds = time.wSecond;
-
-									string s_time = to_string(hours) + " " + to_string(minuts) + " " + to_string(seconds);
-
-
 									switch (uMsg)
 									{
 									case WM_SIZE:
@@ -718,9 +4173,7 @@ namespace app
 									break;
 									case WM_PAINT:
 									{
-										pApp->notify(
-											InputEntered,
-											make_shared < data::UserInterfaceIntputData>(s_time, "timer"));
+										pApp->notifyTime();
 										//ValidateRect(hWnd, NULL);
 									}
 									lr = 0;
@@ -733,9 +4186,7 @@ namespace app
 									break;
 									case WM_TIMER:
 									{
-										pApp->notify(
-											InputEntered, 
-											make_shared < data::UserInterfaceIntputData>(s_time,"timer"));
+										pApp->notifyTime();
 										// pApp->OnCircleRender();
 										// ValidateRect(hWnd, NULL);
 									}
@@ -813,37 +4264,33 @@ namespace app
 									 //	D2D1::ColorF(D2D1::ColorF::SkyBlue)
 									 //);
 
-									D2D1_SIZE_F size = m_data.m_pRenderTarget->GetSize();
-									D2D1_RECT_F rectangle = D2D1::RectF(
-										rec.getLeft(), 
-										rec.getTop(), 
-										rec.getRight(), 
-										rec.getBottom()
-									);
+									DrawHand(rec, angle);
+								}
+								hr = m_data.m_pRenderTarget->EndDraw();
+						}
 
-									const float x = size.width / 2;
-									const float y = size.height / 2;
-																
-									m_data.m_pRenderTarget->SetTransform(
-										D2D1::Matrix3x2F::Rotation(
-											angle, 
-											D2D1::Point2F(x, y)
-										)
-									);
+							if (hr == D2DERR_RECREATE_TARGET)
+							{
+								hr = S_OK;
+								m_data.discardDeviceResources();
+							}
 
-									m_data.m_pRenderTarget->FillRectangle(
-										rectangle,										
-										m_data.m_pLightSlateGrayBrush
-									);
+							return hr;
+						}
 
-									// Restore the identity transformation.
-									m_data.m_pRenderTarget->SetTransform(
-										D2D1::Matrix3x2F::Identity()
-									);
+						HRESULT Win::OnFrameRender(const server_subsystem::data_abstraction::ModelFrameData& frame) {
+							HRESULT hr = S_OK;
+							hr = m_data.createDeviceDependentResource();
 
+							if (SUCCEEDED(hr)) {
+								// one draw pass for the whole frame
+								m_data.m_pRenderTarget->BeginDraw();
+								{
+									for (const auto& hand : frame)
+										DrawHand(hand.getRectangle(), hand.getAngle());
 								}
 								hr = m_data.m_pRenderTarget->EndDraw();
-						}
+							}
 
 							if (hr == D2DERR_RECREATE_TARGET)
 							{
@@ -853,6 +4300,36 @@ namespace app
 
 							return hr;
 						}
+
+						void Win::DrawHand(const server_subsystem::data_abstraction::Rectangle& rec, float angle) {
+							D2D1_SIZE_F size = m_data.m_pRenderTarget->GetSize();
+							D2D1_RECT_F rectangle = D2D1::RectF(
+								rec.getLeft(), 
+								rec.getTop(), 
+								rec.getRight(), 
+								rec.getBottom()
+							);
+
+							const float x = size.width / 2;
+							const float y = size.height / 2;
+														
+							m_data.m_pRenderTarget->SetTransform(
+								D2D1::Matrix3x2F::Rotation(
+									angle, 
+									D2D1::Point2F(x, y)
+								)
+							);
+
+							m_data.m_pRenderTarget->FillRectangle(
+								rectangle,										
+								m_data.m_pLightSlateGrayBrush
+							);
+
+							// Restore the identity transformation.
+							m_data.m_pRenderTarget->SetTransform(
+								D2D1::Matrix3x2F::Identity()
+							);
+						}
 						
 						void Win::OnResize(UINT width, UINT height) {
 
@@ -891,7 +4368,7 @@ namespace app
 				{
 				public:
 					CommandRepositoryImpl();
-					void registerCommand(const string& name, abstraction::data::command::unique_command_ptr c);
+					abstraction::data::exception::Status registerCommand(const string& name, abstraction::data::command::unique_command_ptr&& c);
 					abstraction::data::command::unique_command_ptr deregisterCommand(const string& name);
 
 					size_t count() const { return m_repository.size(); }
@@ -945,18 +4422,14 @@ namespace app
 					return;
 				}
 
-				void CommandRepository::CommandRepositoryImpl::registerCommand(const string& name, abstraction::data::command::unique_command_ptr c)
+				abstraction::data::exception::Status CommandRepository::CommandRepositoryImpl::registerCommand(const string& name, abstraction::data::command::unique_command_ptr&& c)
 				{
 					if (hasKey(name))
-					{
-						std::ostringstream oss;
-						oss << "Command " << name << " already registered";
-						throw abstraction::data::exception::Exception{ oss.str() };
-					}
+						return abstraction::data::exception::ErrorCode::COMMAND_ALREADY_REGISTERED;
 					else
 						m_repository.emplace(name, std::move(c));
 
-					return;
+					return abstraction::data::exception::ErrorCode::NONE;
 				}
 
 				abstraction::data::command::unique_command_ptr CommandRepository::CommandRepositoryImpl::deregisterCommand(const string& name)
@@ -984,8 +4457,9 @@ namespace app
 				}
 
 				CommandRepository::CommandRepository()
-					: pimpl_{ new CommandRepositoryImpl }
 				{
+					service_system::profiler::ScopedPhase phase{ "CommandRepository" };
+					pimpl_.reset(new CommandRepositoryImpl);
 				}
 
 				CommandRepository::~CommandRepository()
@@ -1000,10 +4474,16 @@ namespace app
 
 				void CommandRepository::registerCommand(const string& name, abstraction::data::command::unique_command_ptr c)
 				{
-					pimpl_->registerCommand(name, std::move(c));
+					const auto status = pimpl_->registerCommand(name, std::move(c));
+					if (!status)
+						throw abstraction::data::exception::Exception{ status.message(name) };
 
 					return;
 				}
+				abstraction::data::exception::Status CommandRepository::tryRegisterCommand(const string& name, abstraction::data::command::unique_command_ptr&& c)
+				{
+					return pimpl_->registerCommand(name, std::move(c));
+				}
 				abstraction::data::command::unique_command_ptr CommandRepository::deregisterCommand(const string& name)
 				{
 					return pimpl_->deregisterCommand(name);
@@ -1079,8 +4559,7 @@ namespace app
 							return;
 						else if (sender == "timer") {
 							clientCoordinator.executeCommand(
-								abstraction::data::command::make_unique_command_ptr(
-									new data_abstraction::UpdateCommand(command))
+								data_abstraction::UpdateCommand::make(command)
 							);							
 						}
 						else
@@ -1112,6 +4591,7 @@ namespace app
 
 					CommandDispatcher::CommandDispatcher(client_subsystem::view::boundary::user_interaction::UserInterface& ui)
 					{
+						service_system::profiler::ScopedPhase phase{ "CommandDispatcher" };
 						pimpl_ = std::make_unique<CommandDispatcherImpl>(ui);
 					}
 				}
@@ -1181,15 +4661,24 @@ namespace app
 				using namespace server_subsystem::boundary;
 				using namespace server_subsystem::boundary::proxy;
 
-				ModelObserver model_observer(win);
 				ModelProxy::getInstance().subscribe(
-					ModelProxy::resultAvailable, 
-					std::make_unique<ModelObserver>(model_observer)
+					std::make_unique<ModelFrameObserver>(win)
 				);
 
-				if (SUCCEEDED(win.init())) {
+				HRESULT hr;
+				{
+					service_system::profiler::ScopedPhase phase{ "Win::init" };
+					hr = win.init();
+				}
+				if (SUCCEEDED(hr)) {
 					win.run();
 				}
+
+#ifdef CLOCK_STARTUP_PROFILING
+				std::ostringstream os;
+				service_system::profiler::StartupProfiler::getInstance().report(os);
+				OutputDebugStringA(os.str().c_str());
+#endif
 			}
 
 			CoUninitialize();
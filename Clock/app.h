@@ -5,6 +5,12 @@
 #include<Windows.h>
 #include<d2d1.h>
 #include<d2d1helper.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <sstream>
 #include <unordered_map>
 #include <map>
@@ -12,6 +18,7 @@
 #include <string>
 #include <stack>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 
@@ -51,16 +58,163 @@
 				virtual ~Data() = default;
 			};
 
+			using DataBatch = std::vector<std::shared_ptr<Data>>;
+
 			class InputData : public Data
 			{
 			public:
 				virtual ~InputData() = default;
+
+				// an owned copy, for a service that keeps its input; nullptr when the input cannot be copied
+				virtual std::shared_ptr<InputData> clone() const { return nullptr; }
 			};
 
 			class OutputData : public Data
 			{
 			public:
 				virtual ~OutputData() = default;
+
+				// pooled results go back to their pool instead
+				virtual void deallocate() { delete this; }
+			};
+
+			inline void deallocate(OutputData* d)
+			{
+				if (d)
+					d->deallocate();
+			}
+
+			using unique_output_ptr = std::unique_ptr<OutputData, decltype(&deallocate)>;
+
+			inline auto make_unique_output_ptr(OutputData* d)
+			{
+				return unique_output_ptr{ d, &deallocate };
+			}
+
+			// keeps the deleter, so a pooled result still goes back to its pool
+			inline std::shared_ptr<OutputData> make_shared_output_ptr(unique_output_ptr p)
+			{
+				return std::shared_ptr<OutputData>{ p.release(), &deallocate };
+			}
+
+			using InputBatch = std::vector<std::shared_ptr<InputData>>;
+			using OutputBatch = std::vector<unique_output_ptr>;
+
+			// keeps up to maxIdle released objects; acquire() reuses one through T::reset(args...)
+			// or constructs a new T(args...)
+			template<class T>
+			class ObjectPool
+			{
+			public:
+				struct Statistics
+				{
+					size_t created;
+					size_t reused;
+					size_t discarded;	// released while the pool was full
+					size_t idle;
+				};
+
+				explicit ObjectPool(size_t maxIdle = 64) : m_maxIdle{ maxIdle }
+				{
+					m_idle.reserve(maxIdle);
+				}
+
+				template<class... Args>
+				T* acquire(Args&&... args)
+				{
+					std::unique_ptr<T> obj;
+					{
+						std::lock_guard<std::mutex> lock{ m_mutex };
+						if (!m_idle.empty())
+						{
+							obj = std::move(m_idle.back());
+							m_idle.pop_back();
+							++m_stats.reused;
+						}
+						else
+							++m_stats.created;
+					}
+
+					if (!obj)
+						return new T(std::forward<Args>(args)...);
+					obj->reset(std::forward<Args>(args)...);
+					return obj.release();
+				}
+
+				// appends n objects for a batch, the idle ones taken under a single lock; reset() or a new T()
+				void acquireBatch(size_t n, std::vector<std::unique_ptr<T>>& objects)
+				{
+					objects.reserve(objects.size() + n);
+					const auto first = objects.size();
+					{
+						std::lock_guard<std::mutex> lock{ m_mutex };
+						const auto reused = (std::min)(n, m_idle.size());
+						for (size_t i = 0; i < reused; ++i)
+						{
+							objects.push_back(std::move(m_idle.back()));
+							m_idle.pop_back();
+						}
+						m_stats.reused += reused;
+						m_stats.created += n - reused;
+					}
+
+					for (auto i = first; i < objects.size(); ++i)
+						objects[i]->reset();
+					while (objects.size() < first + n)
+						objects.push_back(std::unique_ptr<T>{ new T() });
+				}
+
+				void release(T* obj)
+				{
+					std::unique_ptr<T> ptr{ obj };
+
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					if (m_idle.size() < m_maxIdle)
+						m_idle.push_back(std::move(ptr));
+					else
+						++m_stats.discarded;
+				}
+
+				Statistics getStatistics() const
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					auto stats = m_stats;
+					stats.idle = m_idle.size();
+					return stats;
+				}
+
+			private:
+				const size_t m_maxIdle;
+				mutable std::mutex m_mutex;
+				std::vector<std::unique_ptr<T>> m_idle;
+				Statistics m_stats{};
+
+			private:
+				ObjectPool(const ObjectPool&) = delete;
+				ObjectPool(ObjectPool&&) = delete;
+				ObjectPool& operator=(const ObjectPool&) = delete;
+				ObjectPool& operator=(ObjectPool&&) = delete;
+			};
+
+			// an output that returns to the pool it was attached to when its unique_output_ptr lets go of it
+			template<class T>
+			class PooledOutputData : public OutputData
+			{
+			public:
+				void attach(std::shared_ptr<ObjectPool<T>> pool) { m_pool = std::move(pool); }
+
+				void deallocate() override
+				{
+					// idle objects must not keep their pool alive
+					auto pool = std::move(m_pool);
+					if (pool)
+						pool->release(static_cast<T*>(this));
+					else
+						delete this;
+				}
+
+			private:
+				std::shared_ptr<ObjectPool<T>> m_pool;
 			};
 
 			class Shape
@@ -123,6 +277,39 @@
 					return unique_command_ptr{ c, &deallocate };
 				}
 
+				// a command that goes back to the free list of its type when its unique_command_ptr lets go of it;
+				// T provides reset(args...) to be refilled like the pooled outputs
+				template<class T>
+				class PooledCommand : public Command
+				{
+				public:
+					template<class... Args>
+					static unique_command_ptr make(Args&&... args)
+					{
+						return make_unique_command_ptr(acquire(std::forward<Args>(args)...));
+					}
+
+					static typename ObjectPool<T>::Statistics getPoolStatistics() { return getPool().getStatistics(); }
+
+					void deallocate() override { getPool().release(static_cast<T*>(this)); }
+
+				protected:
+					PooledCommand() = default;
+					PooledCommand(const PooledCommand&) = default;
+
+					// for clones, which go back to the same free list
+					template<class... Args>
+					static T* acquire(Args&&... args) { return getPool().acquire(std::forward<Args>(args)...); }
+
+				private:
+					static ObjectPool<T>& getPool()
+					{
+						// never destroyed, commands may still be released while statics are torn down
+						static auto* pool = new ObjectPool<T>();
+						return *pool;
+					}
+				};
+
 				// 2: Creational Pattern: Abstract Factory
 				class CommandFactory
 				{
@@ -158,6 +345,48 @@
 				private:
 					std::string m_msg;
 				};
+
+				enum class ErrorCode
+				{
+					NONE,
+					EVENT_NOT_SUPPORTED,
+					EVENT_HANDLE_NOT_SUPPORTED,
+					EVENT_ALREADY_REGISTERED,
+					OBSERVER_ALREADY_REGISTERED,
+					OBSERVER_NOT_FOUND,
+					COMMAND_ALREADY_REGISTERED
+				};
+
+				// result of the non-throwing try* calls: no allocation, the text is only built by message()
+				class Status
+				{
+				public:
+					Status(ErrorCode c = ErrorCode::NONE) noexcept : m_code{ c } {}
+
+					ErrorCode code() const noexcept { return m_code; }
+					bool ok() const noexcept { return m_code == ErrorCode::NONE; }
+					explicit operator bool() const noexcept { return ok(); }
+
+					// subject is the event, observer or command the error is about
+					std::string message(const std::string& subject) const
+					{
+						std::ostringstream oss;
+						switch (m_code)
+						{
+						case ErrorCode::NONE: oss << "No error"; break;
+						case ErrorCode::EVENT_NOT_SUPPORTED: oss << "Event with name '" << subject << "' not supported"; break;
+						case ErrorCode::EVENT_HANDLE_NOT_SUPPORTED: oss << "Event with handle '" << subject << "' not supported"; break;
+						case ErrorCode::EVENT_ALREADY_REGISTERED: oss << "Event already registered"; break;
+						case ErrorCode::OBSERVER_ALREADY_REGISTERED: oss << "Observer '" << subject << "' is already registered"; break;
+						case ErrorCode::OBSERVER_NOT_FOUND: oss << "Observer '" << subject << "' not found registered"; break;
+						case ErrorCode::COMMAND_ALREADY_REGISTERED: oss << "Command " << subject << " already registered"; break;
+						}
+						return oss.str();
+					}
+
+				private:
+					ErrorCode m_code;
+				};
 			}
 
 		} // namespace _system
@@ -186,6 +415,36 @@
 
 			}
 
+			// built by its factory on the first get(), once, whichever thread gets there first
+			template <class T>
+			class Lazy
+			{
+			public:
+				explicit Lazy(std::function<T()> factory) : m_factory{ std::move(factory) }, m_value{} {}
+
+				// a factory that throws leaves it unbuilt, the next get() tries again
+				T& get()
+				{
+					std::call_once(m_once, [this]
+					{
+						m_value = m_factory();
+						m_factory = nullptr;
+					});
+					return m_value;
+				}
+
+			private:
+				std::function<T()> m_factory;
+				std::once_flag m_once;
+				T m_value;
+
+			private:
+				Lazy(const Lazy&) = delete;
+				Lazy(Lazy&&) = delete;
+				Lazy& operator=(const Lazy&) = delete;
+				Lazy& operator=(Lazy&&) = delete;
+			};
+
 			namespace service
 			{
 				class IService
@@ -194,9 +453,53 @@
 					virtual ~IService() = default;
 					virtual std::string getName() const = 0;
 					virtual abstraction::data::OutputData* transform(std::shared_ptr<abstraction::data::InputData> d) = 0;
+					// owned result, services with a result pool override it to hand out recycled objects
+					virtual abstraction::data::unique_output_ptr transformOwned(std::shared_ptr<abstraction::data::InputData> d)
+					{
+						return abstraction::data::make_unique_output_ptr(transform(std::move(d)));
+					}
+					// the input is only lent for the call, nothing may keep a reference to it; the default runs
+					// transformOwned on a copy, services that only read their input override it to skip the copy
+					virtual abstraction::data::unique_output_ptr transformBorrowed(const abstraction::data::InputData& d)
+					{
+						auto copy = d.clone();
+						if (!copy)
+							return abstraction::data::make_unique_output_ptr(nullptr);
+						return transformOwned(std::move(copy));
+					}
+					// a pure service opts into the broker's result cache: makeCacheKey appends a key that identifies
+					// the input completely, or returns false for an input that must not be cached
+					virtual bool isCacheable() const { return false; }
+					virtual bool makeCacheKey(const abstraction::data::InputData&, std::string&) const { return false; }
+					virtual size_t getResultSize(const abstraction::data::OutputData&) const { return sizeof(abstraction::data::OutputData); }
+
+					// appends one result per input, in order; the default is a loop over transformOwned
+					virtual void transformBatch(const abstraction::data::InputBatch& in, abstraction::data::OutputBatch& out)
+					{
+						out.reserve(out.size() + in.size());
+						for (const auto& d : in)
+							out.push_back(transformOwned(d));
+					}
 					virtual const std::string getServiceDescription() const = 0;
 					virtual const std::string getServiceLocalisation() const = 0;
 				};
+
+				// bytes of the data of one service, to run it in another process; a payload is measured first,
+				// then written straight into the memory it is sent from
+				class IServiceCodec
+				{
+				public:
+					virtual ~IServiceCodec() = default;
+					// false for data this codec cannot carry
+					virtual bool measureInput(const abstraction::data::InputData& d, size_t& size) const = 0;
+					virtual void writeInput(const abstraction::data::InputData& d, char* out) const = 0;
+					// null for bytes that do not decode
+					virtual std::shared_ptr<abstraction::data::InputData> readInput(const char* in, size_t size) const = 0;
+
+					virtual bool measureOutput(const abstraction::data::OutputData& d, size_t& size) const = 0;
+					virtual void writeOutput(const abstraction::data::OutputData& d, char* out) const = 0;
+					virtual abstraction::data::unique_output_ptr readOutput(const char* in, size_t size) const = 0;
+				};
 			}
 
 		} // namespace logic
@@ -224,6 +527,11 @@
 					Observer(const std::string& n) : name{ n } {}
 					const std::string& getName() const { return name; }
 					virtual void notify(std::shared_ptr<abstraction::data::Data> d) { notifyImpl(d); };
+					virtual void notifyBatch(const abstraction::data::DataBatch& batch)
+					{
+						for (const auto& d : batch)
+							notifyImpl(d);
+					}
 					virtual ~Observer() = default;
 
 				private:
@@ -232,6 +540,76 @@
 				private:
 					std::string name;
 				};
+
+				// statically typed channel: the event is handed to the observers by const reference,
+				// no shared_ptr and no dynamic_pointer_cast on the way
+				namespace channel
+				{
+					template <class EventT>
+					class Observer
+					{
+					public:
+						Observer(const std::string& n) : name{ n } {}
+						const std::string& getName() const { return name; }
+						void notify(const EventT& e) { notifyImpl(e); }
+						virtual ~Observer() = default;
+
+					private:
+						virtual void notifyImpl(const EventT& e) = 0;
+
+					private:
+						std::string name;
+					};
+
+					// single threaded, observers are called in subscription order
+					template <class EventT>
+					class Publisher
+					{
+					public:
+						void subscribe(std::unique_ptr<Observer<EventT>> observer)
+						{
+							if (find(observer->getName()) != m_observers.end())
+							{
+								std::ostringstream oss;
+								oss << "Observer '" << observer->getName() << "' is already registered";
+								throw abstraction::data::exception::Exception(oss.str());
+							}
+							m_observers.push_back(std::move(observer));
+						}
+
+						void unsubscribe(const std::string& observerName)
+						{
+							auto ptr = find(observerName);
+							if (ptr == m_observers.end())
+							{
+								std::ostringstream oss;
+								oss << "Observer '" << observerName << "' not found registered";
+								throw abstraction::data::exception::Exception(oss.str());
+							}
+							m_observers.erase(ptr);
+						}
+
+						void notify(const EventT& e) const
+						{
+							for (const auto& obs : m_observers)
+								obs->notify(e);
+						}
+
+						bool empty() const { return m_observers.empty(); }
+
+					private:
+						using Observers = std::vector<std::unique_ptr<Observer<EventT>>>;
+
+						typename Observers::iterator find(const std::string& observerName)
+						{
+							return std::find_if(m_observers.begin(), m_observers.end(), [&](const auto& o) {
+								return o->getName() == observerName; });
+						}
+
+					private:
+						Observers m_observers;
+					};
+				}
 			}
 
 			namespace device_input_output
@@ -289,6 +667,64 @@
 			};
 		}
 
+		namespace profiler
+		{
+			// how long each singleton and service took to build, for the cold start
+			class StartupProfiler
+			{
+			public:
+				using clock = std::chrono::steady_clock;
+
+				struct Phase
+				{
+					std::string name;
+					clock::duration start;		// since the profiler was created
+					clock::duration duration;
+					unsigned depth;				// phases already running on that thread
+				};
+
+				static StartupProfiler& getInstance();
+
+				void record(const char* name, clock::time_point start, clock::duration duration, unsigned depth);
+				// in start order
+				std::vector<Phase> getPhases() const;
+				// one line per phase, nested phases indented under the one they ran in
+				void report(std::ostream& os) const;
+
+			private:
+				StartupProfiler();
+
+				const clock::time_point m_origin;
+				mutable std::mutex m_mutex;
+				std::vector<Phase> m_phases;
+
+			private:
+				StartupProfiler(const StartupProfiler&) = delete;
+				StartupProfiler(StartupProfiler&&) = delete;
+				StartupProfiler& operator=(const StartupProfiler&) = delete;
+				StartupProfiler& operator=(StartupProfiler&&) = delete;
+			};
+
+			// records the lifetime of the scope as a phase, name must outlive it
+			class ScopedPhase
+			{
+			public:
+				explicit ScopedPhase(const char* name);
+				~ScopedPhase();
+
+			private:
+				const char* m_name;
+				StartupProfiler::clock::time_point m_start;
+				unsigned m_depth;
+
+			private:
+				ScopedPhase(const ScopedPhase&) = delete;
+				ScopedPhase(ScopedPhase&&) = delete;
+				ScopedPhase& operator=(const ScopedPhase&) = delete;
+				ScopedPhase& operator=(ScopedPhase&&) = delete;
+			};
+		}
+
 		namespace publisher
 		{
 			namespace publisher_data_abstraction
@@ -297,6 +733,44 @@
 				{
 				public:
 				};
+
+				// what an asynchronous Publisher does with a notification when its queue is full
+				enum class OverflowPolicy
+				{
+					Block,			// the notifying thread waits for a free slot
+					DropOldest,		// the oldest pending notification is discarded
+					CoalesceByKey	// replaces the pending notification with the same event and key, else DropOldest
+				};
+
+				struct DispatchQueueOptions
+				{
+					std::size_t capacity = 1024;
+					OverflowPolicy policy = OverflowPolicy::Block;
+					std::size_t dispatcherThreads = 1;
+				};
+
+				struct DispatchStatistics
+				{
+					std::size_t depth = 0;
+					std::size_t highWater = 0;
+					std::uint64_t enqueued = 0;
+					std::uint64_t dispatched = 0;
+					std::uint64_t dropped = 0;
+					std::uint64_t coalesced = 0;
+					std::uint64_t failed = 0;		// observers that threw on a dispatcher thread
+				};
+
+				// per event and observer, recorded only when CLOCK_PUBLISHER_INSTRUMENTATION is defined
+				struct ObserverStatistics
+				{
+					static const std::size_t bucketCount = 32;
+
+					std::string eventName;
+					std::string observerName;
+					std::uint64_t calls = 0;
+					std::uint64_t totalNanoseconds = 0;
+					std::array<std::uint64_t, bucketCount> histogram{};	// bucket i counts latencies in [2^i, 2^(i+1)) ns
+				};
 			}
 
 			class Publisher : public abstraction::logic::service::IService
@@ -305,9 +779,26 @@
 				class PublisherImpl;
 
 			public:
-				Publisher();
-				void subscribe(const std::string& eventName, std::unique_ptr<abstraction::boundary::proxy::Observer> observer);
+				// compact handle returned by registerEvent, used to index the event table directly
+				enum class EventHandle : std::size_t {};
+
+				enum class PublishingStrategy
+				{
+					Synchronous,	// single threaded
+					Concurrent,		// notify may run on any thread while others (un)subscribe
+					Asynchronous	// notify queues the event, dispatcher threads call the observers
+				};
+
+			public:
+				Publisher(PublishingStrategy st = PublishingStrategy::Synchronous,
+					const publisher_data_abstraction::DispatchQueueOptions& options = publisher_data_abstraction::DispatchQueueOptions{});
+				// observers are notified by decreasing priority, then in subscription order
+				void subscribe(const std::string& eventName, std::unique_ptr<abstraction::boundary::proxy::Observer> observer, int priority = 0);
+				void subscribe(EventHandle event, std::unique_ptr<abstraction::boundary::proxy::Observer> observer, int priority = 0);
+				// one snapshot copy for the whole batch, none is subscribed if one of the names is taken
+				void subscribeMany(EventHandle event, std::vector<std::unique_ptr<abstraction::boundary::proxy::Observer>> observers, int priority = 0);
 				void unsubscribe(const std::string& eventName, const std::string& observerName);
+				void unsubscribe(EventHandle event, const std::string& observerName);
 				std::string getName() const noexcept override { return name; }
 				const std::string getServiceDescription() const override { return "This Class is used for subscription"; }
 				const std::string getServiceLocalisation() const override { return "Located somewhere"; }
@@ -317,8 +808,26 @@
 				};
 
 				virtual ~Publisher();
+
+				// non-throwing variants for the hot paths, trySubscribe leaves observer untouched on failure
+				abstraction::data::exception::Status trySubscribe(EventHandle event, std::unique_ptr<abstraction::boundary::proxy::Observer>&& observer, int priority = 0);
+				abstraction::data::exception::Status trySubscribeMany(EventHandle event, std::vector<std::unique_ptr<abstraction::boundary::proxy::Observer>>&& observers, int priority = 0);
+				abstraction::data::exception::Status tryUnsubscribe(EventHandle event, const std::string& observerName);
+				abstraction::data::exception::Status tryNotify(EventHandle event, std::shared_ptr<abstraction::data::Data>) const;
+				abstraction::data::exception::Status tryRegisterEvent(const std::string& eventName, EventHandle& event);
+				abstraction::data::exception::Status tryGetEventHandle(const std::string& eventName, EventHandle& event) const;
+
 				void notify(const std::string& eventName, std::shared_ptr<abstraction::data::Data>) const;
-				void registerEvent(const std::string& eventName);
+				void notify(EventHandle event, std::shared_ptr<abstraction::data::Data>) const;
+				void notify(EventHandle event, std::shared_ptr<abstraction::data::Data>, std::size_t coalescingKey) const;
+				void notifyBatch(const std::string& eventName, const abstraction::data::DataBatch& batch) const;
+				void notifyBatch(EventHandle event, const abstraction::data::DataBatch& batch) const;
+				EventHandle registerEvent(const std::string& eventName);
+				EventHandle getEventHandle(const std::string& eventName) const;
+				bool hasObservers(EventHandle event) const;
+				publisher_data_abstraction::DispatchStatistics getDispatchStatistics() const;
+				std::vector<publisher_data_abstraction::ObserverStatistics> getObserverStatistics() const;
+				void resetObserverStatistics();
 
 			private:
 				std::unique_ptr<PublisherImpl> impl;
@@ -328,44 +837,202 @@
 		namespace tokenizer
 		{
 			namespace data {
-				class TokenizerInputData : abstraction::data::InputData
+				enum class CaseTransform { None, Upper, Lower };
+
+				class TokenizerInputData : public abstraction::data::InputData
 				{
 				public:
-					TokenizerInputData(const std::string& str, char token)
-						: m_sData{ str }, m_cToken{ token }{}
+					TokenizerInputData(const std::string& str, char token, CaseTransform ct = CaseTransform::Upper)
+						: m_sData{ str }, m_sDelimiters(1, token), m_case{ ct }{}
+					// any of the delimiters ends a token
+					TokenizerInputData(const std::string& str, const std::string& delimiters, CaseTransform ct = CaseTransform::Upper)
+						: m_sData{ str }, m_sDelimiters{ delimiters }, m_case{ ct }{}
 
 					~TokenizerInputData()
 					{
 					}
 					const std::string& getData()const { return m_sData; }
-					char getToken()const { return m_cToken; }
+					char getToken()const { return m_sDelimiters[0]; }
+					const std::string& getDelimiters()const { return m_sDelimiters; }
+					CaseTransform getCaseTransform()const { return m_case; }
+
+					std::shared_ptr<abstraction::data::InputData> clone() const override { return std::make_shared<TokenizerInputData>(*this); }
 
 				private:
 					std::string m_sData;
+					std::string m_sDelimiters;
+					CaseTransform m_case;
+				};
+
+				// borrows the caller's buffer, which must outlive the TokenizerSpanOutputData produced from it
+				class TokenizerViewInputData : public abstraction::data::InputData
+				{
+				public:
+					TokenizerViewInputData(const char* first, size_t size, char token)
+						: m_first{ first }, m_size{ size }, m_cToken{ token }{}
+
+					const char* getData()const { return m_first; }
+					size_t getSize()const { return m_size; }
+					char getToken()const { return m_cToken; }
+
+					// the copy borrows the same buffer
+					std::shared_ptr<abstraction::data::InputData> clone() const override { return std::make_shared<TokenizerViewInputData>(*this); }
+
+				private:
+					const char* m_first;
+					size_t m_size;
 					char m_cToken;
 				};
 
+				struct TokenSpan
+				{
+					size_t offset;
+					size_t length;
+				};
 
-				class TokenizerOutputData : public abstraction::data::OutputData
+				// tokens as offset/length pairs into the borrowed buffer, nothing is copied
+				class TokenizerSpanOutputData : public abstraction::data::OutputData
+				{
+					using Spans = std::vector<TokenSpan>;
+					using const_iterator = Spans::const_iterator;
+
+				public:
+					TokenizerSpanOutputData(const char* buffer, Spans&& spans)
+						: m_buffer{ buffer }, m_spans{ std::move(spans) } {}
+
+					const_iterator begin() const { return m_spans.cbegin(); }
+					const_iterator end() const { return m_spans.cend(); }
+					const TokenSpan& operator[](size_t i) const { return m_spans[i]; }
+					size_t size() const { return m_spans.size(); }
+
+					const char* getBuffer() const { return m_buffer; }
+					const char* data(size_t i) const { return m_buffer + m_spans[i].offset; }
+					std::string str(size_t i) const { return std::string(data(i), m_spans[i].length); }
+
+				private:
+					const char* m_buffer;
+					Spans m_spans;
+				};
+
+
+				class TokenizerOutputData : public abstraction::data::PooledOutputData<TokenizerOutputData>
 				{
 					using Token = std::string;
 					using Tokens = std::vector<std::string>;
 					using const_iterator = Tokens::const_iterator;
 
 				public:
+					TokenizerOutputData() = default;
 					TokenizerOutputData(const std::vector<std::string> &strs)
-						:m_tokens{ strs } {}
+						:m_tokens{ strs }, m_count{ strs.size() } {}
+					TokenizerOutputData(std::vector<std::string>&& strs)
+						:m_tokens{ std::move(strs) }, m_count{ m_tokens.size() } {}
 
 					~TokenizerOutputData()
 					{
 					}
+
+					// a recycled object keeps its strings, refilling it with tokens of similar size does not allocate
+					void reset() { m_count = 0; }
+					void reserve(size_t n) { m_tokens.reserve(n); }
+					void emplace_back(const char* first, size_t length)
+					{
+						if (m_count == m_tokens.size())
+							m_tokens.emplace_back();
+						m_tokens[m_count++].assign(first, length);
+					}
+					Token& back() { return m_tokens[m_count - 1]; }
+
 					const_iterator begin() const { return m_tokens.cbegin(); }
-					const_iterator end() const { return m_tokens.cend(); }
+					const_iterator end() const { return m_tokens.cbegin() + m_count; }
 					const Token& operator[](size_t i) const { return m_tokens[i]; }
-					size_t size() const { return m_tokens.size(); }
+					size_t size() const { return m_count; }
+
+					// memory held, the strings kept past size() from an earlier use included
+					size_t getByteSize() const
+					{
+						size_t bytes = sizeof(*this) + m_tokens.capacity() * sizeof(Token);
+						for (const auto& token : m_tokens)
+							bytes += token.capacity();
+						return bytes;
+					}
 
 				private:
 					Tokens m_tokens;
+					size_t m_count{};
+				};
+
+				// token bytes back to back in one buffer plus their spans, clear() keeps the capacity
+				// so a reused arena stops allocating once it has seen its largest input
+				class TokenArena
+				{
+					using Spans = std::vector<TokenSpan>;
+					using const_iterator = Spans::const_iterator;
+
+				public:
+					// applied in place to the copied bytes of a token, before interning
+					using Transform = void(*)(char* first, size_t size);
+
+					// with interning an equal token reuses the bytes of the first one
+					explicit TokenArena(bool intern = false) : m_intern{ intern } {}
+
+					void clear();
+					void reserve(size_t bytes, size_t tokens);
+					size_t add(const char* first, size_t length, Transform transform = nullptr);	// returns the token index
+					void add(const char* input, const std::vector<TokenSpan>& spans, Transform transform = nullptr);
+
+					const_iterator begin() const { return m_spans.cbegin(); }
+					const_iterator end() const { return m_spans.cend(); }
+					const TokenSpan& operator[](size_t i) const { return m_spans[i]; }
+					size_t size() const { return m_spans.size(); }
+
+					const char* getBytes() const { return m_bytes.data(); }
+					size_t getByteSize() const { return m_bytes.size(); }
+					size_t getUniqueCount() const { return m_intern ? m_unique : m_spans.size(); }
+					const char* data(size_t i) const { return m_bytes.data() + m_spans[i].offset; }
+					std::string str(size_t i) const { return std::string(data(i), m_spans[i].length); }
+
+				private:
+					static size_t hash(const char* first, size_t length);
+					size_t intern(size_t offset, size_t length);
+					void grow();
+
+					const bool m_intern;
+					std::vector<char> m_bytes;
+					Spans m_spans;
+					std::vector<size_t> m_slots;	// open addressing, index + 1 of the first span with those bytes
+					size_t m_unique{};
+				};
+
+				// the tokens are written to a caller provided arena, which may be reused once the output is released
+				class TokenizerArenaInputData : public TokenizerViewInputData
+				{
+				public:
+					TokenizerArenaInputData(const char* first, size_t size, char token, std::shared_ptr<TokenArena> arena, CaseTransform ct = CaseTransform::Upper)
+						: TokenizerViewInputData{ first, size, token }, m_arena{ std::move(arena) }, m_case{ ct }{}
+
+					const std::shared_ptr<TokenArena>& getArena()const { return m_arena; }
+					CaseTransform getCaseTransform()const { return m_case; }
+
+					std::shared_ptr<abstraction::data::InputData> clone() const override { return std::make_shared<TokenizerArenaInputData>(*this); }
+
+				private:
+					std::shared_ptr<TokenArena> m_arena;
+					CaseTransform m_case;
+				};
+
+				class TokenizerArenaOutputData : public abstraction::data::OutputData
+				{
+				public:
+					explicit TokenizerArenaOutputData(std::shared_ptr<const TokenArena> arena)
+						: m_arena{ std::move(arena) } {}
+
+					const TokenArena& getArena() const { return *m_arena; }
+					size_t size() const { return m_arena->size(); }
+					std::string str(size_t i) const { return m_arena->str(i); }
+
+				private:
+					std::shared_ptr<const TokenArena> m_arena;
 				};
 
 			}
@@ -381,7 +1048,205 @@
 			{
 				namespace business
 				{
+					enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+					// best level supported by the cpu and the os, detected once
+					SimdLevel getSimdLevel() noexcept;
+
+					// single pass, appends to spans; separators are the delimiter and the characters istream >> skips
+					void tokenize(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans);
+					void toUpper(char* first, size_t size);	// ASCII only
+
+					// every level gives the same output, a level above getSimdLevel() is lowered to it
+					void tokenize(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans, SimdLevel level);
+					void toUpper(char* first, size_t size, SimdLevel level);
+
+					// splits the input into ranges that start on a separator, one per worker, and appends the spans in input order;
+					// threads == 0 uses every core, small inputs stay on the calling thread
+					void tokenizeParallel(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans, unsigned threads = 0);
+
+					// token bytes are only valid during the call, offset is the position in the whole input
+					using TokenCallback = std::function<void(const char* token, size_t length, uint64_t offset)>;
+
+					// reads fixed size chunks and carries a token that crosses a chunk boundary over to the next one,
+					// memory stays bounded by the chunk size plus the longest token
+					class StreamTokenizer
+					{
+					public:
+						explicit StreamTokenizer(char delimiter, size_t chunkSize = 1 << 20)
+							: m_delimiter{ delimiter }, m_chunkSize{ chunkSize ? chunkSize : 1 } {}
+
+						// both return the number of tokens passed to callback
+						uint64_t tokenize(std::istream& in, const TokenCallback& callback);
+						uint64_t tokenizeFile(const std::wstring& path, const TokenCallback& callback);	// memory-mapped windows
+
+					private:
+						void reset();
+						void feed(const char* first, size_t size, bool last, const TokenCallback& callback);
+
+						char m_delimiter;
+						size_t m_chunkSize;
+						std::string m_carry;
+						uint64_t m_carryOffset{};
+						uint64_t m_offset{};	// of the chunk being fed
+						uint64_t m_count{};
+						std::vector<data::TokenSpan> m_spans;
+					};
+
+					// 256 entry lookup table indexed by the byte, buildable at compile time
+					struct CharTable
+					{
+						unsigned char value[256];
+
+						constexpr unsigned char operator[](char c) const { return value[static_cast<unsigned char>(c)]; }
+					};
+
+					constexpr CharTable identityTable()
+					{
+						CharTable t{};
+						for (int c = 0; c < 256; ++c)
+							t.value[c] = static_cast<unsigned char>(c);
+						return t;
+					}
+
+					// separator table for a delimiter set only known at run time
+					CharTable makeDelimiterTable(const std::string& delimiters);
+
+					// tokenizeParallel for the separators of a table, a byte is one when its entry is non zero
+					void tokenizeParallel(const CharTable& separators, const char* first, size_t size, std::vector<data::TokenSpan>& spans, unsigned threads = 0);
+
+					template<char... Ds>
+					struct Delimiters
+					{
+						static constexpr CharTable table()
+						{
+							CharTable t{};
+							const char ds[] = { Ds..., '\0' };
+							for (size_t i = 0; i < sizeof...(Ds); ++i)
+								t.value[static_cast<unsigned char>(ds[i])] = 1;
+							return t;
+						}
+					};
 
+					// whitespace policies: add the characters istream >> skips to the separators, or not
+					struct SplitOnWhitespace
+					{
+						static constexpr CharTable apply(CharTable t)
+						{
+							t.value[static_cast<unsigned char>(' ')] = 1;
+							for (int c = '\t'; c <= '\r'; ++c)
+								t.value[c] = 1;
+							return t;
+						}
+					};
+
+					struct KeepWhitespace
+					{
+						static constexpr CharTable apply(CharTable t) { return t; }
+					};
+
+					// transform policies map every byte of a token through table(), a custom policy
+					// is any type with the same two members
+					struct NoTransform
+					{
+						static const bool enabled = false;
+						static constexpr CharTable table() { return identityTable(); }
+					};
+
+					struct UpperTransform
+					{
+						static const bool enabled = true;
+						static constexpr CharTable table()
+						{
+							CharTable t = identityTable();
+							for (int c = 'a'; c <= 'z'; ++c)
+								t.value[c] = static_cast<unsigned char>(c - ('a' - 'A'));
+							return t;
+						}
+					};
+
+					struct LowerTransform
+					{
+						static const bool enabled = true;
+						static constexpr CharTable table()
+						{
+							CharTable t = identityTable();
+							for (int c = 'A'; c <= 'Z'; ++c)
+								t.value[c] = static_cast<unsigned char>(c + ('a' - 'A'));
+							return t;
+						}
+					};
+
+					// the loops only look up tables, the configuration is all in the template arguments
+					template<class TransformPolicy>
+					class TableTokenizer
+					{
+					public:
+						static void tokenize(const CharTable& separators, const char* first, size_t size, std::vector<data::TokenSpan>& spans)
+						{
+							size_t i = 0;
+							while (i < size)
+							{
+								while (i < size && separators[first[i]])
+									++i;
+								const size_t begin = i;
+								while (i < size && !separators[first[i]])
+									++i;
+								if (i > begin)
+									spans.push_back(data::TokenSpan{ begin, i - begin });
+							}
+						}
+
+						// Tokens is any container with emplace_back(first, length) and back()
+						template<class Tokens>
+						static void tokenize(const CharTable& separators, const char* first, size_t size, Tokens& tokens)
+						{
+							size_t i = 0;
+							while (i < size)
+							{
+								while (i < size && separators[first[i]])
+									++i;
+								const size_t begin = i;
+								while (i < size && !separators[first[i]])
+									++i;
+								if (i > begin)
+								{
+									tokens.emplace_back(first + begin, i - begin);
+									transform(&tokens.back()[0], i - begin);
+								}
+							}
+						}
+
+						static void transform(char* first, size_t size)
+						{
+							static constexpr CharTable map = TransformPolicy::table();
+							if (TransformPolicy::enabled)
+								for (size_t i = 0; i < size; ++i)
+									first[i] = static_cast<char>(map[first[i]]);
+						}
+					};
+
+					template<class DelimiterSet, class WhitespacePolicy = SplitOnWhitespace, class TransformPolicy = NoTransform>
+					class Tokenizer
+					{
+					public:
+						static void tokenize(const char* first, size_t size, std::vector<data::TokenSpan>& spans)
+						{
+							TableTokenizer<TransformPolicy>::tokenize(separators(), first, size, spans);
+						}
+
+						static void tokenize(const char* first, size_t size, std::vector<std::string>& tokens)
+						{
+							TableTokenizer<TransformPolicy>::tokenize(separators(), first, size, tokens);
+						}
+
+					private:
+						static const CharTable& separators()
+						{
+							static constexpr CharTable table = WhitespacePolicy::apply(DelimiterSet::table());
+							return table;
+						}
+					};
 				} // namespace business
 
 				namespace service
@@ -390,20 +1255,62 @@
 					{
 						static const std::string name; // = "tokenizer";
 					public:
-						TokenizerService()=default;
+						// threads > 1, or 0 for every core, tokenizes large inputs in parallel
+						explicit TokenizerService(unsigned threads = 1)
+							: m_threads{ threads }, m_pool{ std::make_shared<abstraction::data::ObjectPool<data::TokenizerOutputData>>() } {}
 
 						std::string getName() const noexcept override { return name; }
 						const std::string getServiceDescription() const override { return "tokenize the string"; }
 						const std::string getServiceLocalisation() const override { return "located somewhere"; }
 
 						abstraction::data::OutputData* transform(std::shared_ptr<abstraction::data::InputData> d) override;
+						abstraction::data::unique_output_ptr transformOwned(std::shared_ptr<abstraction::data::InputData> d) override;
+						abstraction::data::unique_output_ptr transformBorrowed(const abstraction::data::InputData& d) override;
+						void transformBatch(const abstraction::data::InputBatch& in, abstraction::data::OutputBatch& out) override;
 						~TokenizerService();
 
+						// only owning inputs are cached, view and arena inputs borrow caller memory
+						bool isCacheable() const override { return true; }
+						bool makeCacheKey(const abstraction::data::InputData& d, std::string& key) const override;
+						size_t getResultSize(const abstraction::data::OutputData& d) const override;
+
+						abstraction::data::ObjectPool<data::TokenizerOutputData>::Statistics getPoolStatistics() const { return m_pool->getStatistics(); }
+
+						// clears arena and fills it, no allocation once the arena and the calling thread have warmed up
+						void tokenize(const char* first, size_t size, char delimiter, data::CaseTransform ct, data::TokenArena& arena) const;
+
 					private:
 						TokenizerService(const TokenizerService&) = delete;
 						TokenizerService(TokenizerService&&) = delete;
 						TokenizerService& operator=(const TokenizerService&) = delete;
 						TokenizerService& operator=(TokenizerService&&) = delete;
+
+						void tokenize(const char* first, size_t size, char delimiter, std::vector<data::TokenSpan>& spans) const;
+						void tokenize(const data::TokenizerInputData& in, data::TokenizerOutputData& out) const;
+						abstraction::data::OutputData* transformInput(const abstraction::data::InputData& d) const;
+
+						const unsigned m_threads;
+						// shared with the results handed out, which may outlive the service
+						std::shared_ptr<abstraction::data::ObjectPool<data::TokenizerOutputData>> m_pool;
+					};
+
+					// carries TokenizerInputData and TokenizerOutputData, the only data a hosted tokenizer exchanges
+					class TokenizerCodec : public abstraction::logic::service::IServiceCodec
+					{
+					public:
+						TokenizerCodec() : m_pool{ std::make_shared<abstraction::data::ObjectPool<data::TokenizerOutputData>>() } {}
+
+						bool measureInput(const abstraction::data::InputData& d, size_t& size) const override;
+						void writeInput(const abstraction::data::InputData& d, char* out) const override;
+						std::shared_ptr<abstraction::data::InputData> readInput(const char* in, size_t size) const override;
+
+						bool measureOutput(const abstraction::data::OutputData& d, size_t& size) const override;
+						void writeOutput(const abstraction::data::OutputData& d, char* out) const override;
+						abstraction::data::unique_output_ptr readOutput(const char* in, size_t size) const override;
+
+					private:
+						// decoded results are recycled like the ones of the service
+						std::shared_ptr<abstraction::data::ObjectPool<data::TokenizerOutputData>> m_pool;
 					};
 				}
 			}
@@ -413,8 +1320,84 @@
 
 	namespace broker_system
 	{
+		// fixed set of threads running posted jobs in arrival order; the destructor finishes the queue, then joins
+		class WorkerPool
+		{
+		public:
+			explicit WorkerPool(unsigned threads);
+			~WorkerPool();
+
+			void post(std::function<void()> job);
+			unsigned getThreadCount() const noexcept;
+
+		private:
+			class WorkerPoolImpl;
+			std::unique_ptr<WorkerPoolImpl> pimpl_;
+
+		private:
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool(WorkerPool&&) = delete;
+			WorkerPool& operator=(const WorkerPool&) = delete;
+			WorkerPool& operator=(WorkerPool&&) = delete;
+		};
+
 		namespace white_page
 		{
+			class BrokerForwarder;
+
+			// byte-budgeted LRU of shared results, safe to use from several threads
+			class ResultCache
+			{
+			public:
+				struct Statistics
+				{
+					size_t hits;
+					size_t misses;
+					size_t evictions;
+					size_t entries;
+					size_t bytes;
+					size_t budget;
+				};
+
+				explicit ResultCache(size_t byteBudget = 0);
+				~ResultCache();
+
+				// 0 disables the cache and empties it
+				void setBudget(size_t byteBudget);
+				bool isEnabled() const noexcept;
+
+				std::shared_ptr<const abstraction::data::OutputData> find(const std::string& key);
+				// evicts the least recently used entries to make room, a value larger than the budget is not kept
+				void insert(const std::string& key, std::shared_ptr<const abstraction::data::OutputData> value, size_t bytes);
+				void clear();
+
+				Statistics getStatistics() const;
+
+			private:
+				class ResultCacheImpl;
+				std::unique_ptr<ResultCacheImpl> pimpl_;
+
+			private:
+				ResultCache(const ResultCache&) = delete;
+				ResultCache(ResultCache&&) = delete;
+				ResultCache& operator=(const ResultCache&) = delete;
+				ResultCache& operator=(ResultCache&&) = delete;
+			};
+
+			// resolved once by name, then forwards without any lookup; services live as long as the broker
+			class ServiceHandle
+			{
+			public:
+				ServiceHandle() = default;
+				explicit operator bool() const noexcept { return m_service != nullptr; }
+
+			private:
+				friend class BrokerForwarder;
+				explicit ServiceHandle(abstraction::logic::service::IService* s) : m_service{ s } {}
+
+				abstraction::logic::service::IService* m_service{};
+			};
+
 			class BrokerForwarder
 			{
 			public:
@@ -428,13 +1411,56 @@
 				{
 					return false;
 				}
-				abstraction::data::OutputData* forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept;
+				ServiceHandle resolve(const std::string& serviceName) const noexcept;
+
+				// the reference overloads lend data to the service for the call only, nothing is copied
+				abstraction::data::unique_output_ptr forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept;
+				abstraction::data::unique_output_ptr forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept;
+				abstraction::data::unique_output_ptr forward(ServiceHandle service, const abstraction::data::InputData& data) const noexcept;
+				abstraction::data::unique_output_ptr forward(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const noexcept;
+
+				// served from the result cache when it is enabled and the service is cacheable, results are shared
+				// with the cache and must not be modified
+				std::shared_ptr<const abstraction::data::OutputData> forwardCached(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept;
+				std::shared_ptr<const abstraction::data::OutputData> forwardCached(ServiceHandle service, const abstraction::data::InputData& data) const noexcept;
+				std::shared_ptr<const abstraction::data::OutputData> forwardCached(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const noexcept;
+
+				// opt-in, 0 (the default) disables caching
+				void setCacheBudget(size_t byteBudget) { m_cache.setBudget(byteBudget); }
+				ResultCache::Statistics getCacheStatistics() const { return m_cache.getStatistics(); }
+
+				// one result per input, in order, all null for an unknown service; the service is resolved once
+				abstraction::data::OutputBatch forwardBatch(const std::string& serviceName, const abstraction::data::InputBatch& data) const noexcept;
+				abstraction::data::OutputBatch forwardBatch(ServiceHandle service, const abstraction::data::InputBatch& data) const noexcept;
+
+				// run on the broker's worker pool; an unknown service gives a null result, an exception from the
+				// service is rethrown by the future and gives a null result to the callback
+				std::future<abstraction::data::unique_output_ptr> forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const;
+				std::future<abstraction::data::unique_output_ptr> forwardAsync(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data) const;
+				void forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data, std::function<void(abstraction::data::unique_output_ptr)> done) const;
+				void forwardAsync(ServiceHandle service, std::shared_ptr<abstraction::data::InputData> data, std::function<void(abstraction::data::unique_output_ptr)> done) const;
+
+				// shared by every async broker call, started on first use
+				std::shared_ptr<WorkerPool> getWorkerPool() const;
+				// 0 uses every core; applies to the next request, the ones already queued still complete
+				// without the caller waiting for them, so a completion callback may call it too
+				void setWorkerThreads(unsigned threads);
 			private:
-				BrokerForwarder() : m_services{}
-				{					
-					m_services.insert(std::make_pair("tokenizer", std::make_unique<service_system::tokenizer::logic::service::TokenizerService>()));
-				}
-				std::unordered_map<std::string, std::unique_ptr<abstraction::logic::service::IService>> m_services;
+				BrokerForwarder();
+
+				// owner is null when data is only lent for the call
+				std::shared_ptr<const abstraction::data::OutputData> forwardCached(ServiceHandle service, const abstraction::data::InputData& data,
+					std::shared_ptr<abstraction::data::InputData> owner) const noexcept;
+
+				// registered as factories, each service is built by the first request that resolves it
+				using LazyService = abstraction::logic::Lazy<std::unique_ptr<abstraction::logic::service::IService>>;
+				std::unordered_map<std::string, std::unique_ptr<LazyService>> m_services;
+				mutable ResultCache m_cache;
+
+				// started on the first async request, destroyed before the services it runs
+				mutable std::mutex m_workersMutex;
+				mutable std::shared_ptr<WorkerPool> m_workers;
+				unsigned m_workerThreads{};
 
 			private:
 				BrokerForwarder(const BrokerForwarder&) = delete;
@@ -442,23 +1468,67 @@
 				BrokerForwarder& operator=(const BrokerForwarder&) = delete;
 				BrokerForwarder& operator=(BrokerForwarder&&) = delete;
 			};
+			// how BrokerHandler spreads the requests for one name over the instances registered under it
+			enum class BalancePolicy
+			{
+				RoundRobin,
+				LeastOutstanding,	// the instance with the fewest calls in progress
+				KeyAffinity			// inputs with the same key go to the same instance, the others round robin
+			};
+
 			class BrokerHandler
 			{
 			public:
+				struct InstanceLoad
+				{
+					size_t outstanding;		// calls in progress
+					size_t requests;		// calls handed to it
+				};
+
+				// appends the KeyAffinity key of an input, false when it has none
+				using KeyFunction = std::function<bool(const abstraction::data::InputData&, std::string&)>;
+
 				static BrokerHandler& getInstance()
 				{
 					static BrokerHandler instance;
 					return instance;
 				}
 				~BrokerHandler() = default;
+
+				// each call adds one more instance under the name, false for a null service;
+				// the first one also gives the group its key, through makeCacheKey
 				bool registerService(std::shared_ptr<abstraction::logic::service::IService> s) noexcept;
+				// an instance built on first use
+				bool registerService(const std::string& serviceName, std::function<std::shared_ptr<abstraction::logic::service::IService>()> factory) noexcept;
+				// RoundRobin until set, false for an unknown name; a null key keeps the one of the group,
+				// KeyAffinity without any key goes round robin, no instance is built to find the keys
+				bool setPolicy(const std::string& serviceName, BalancePolicy policy, KeyFunction key = nullptr) noexcept;
+
+				// the first instance registered under the name, the policy only applies to forward
 				std::shared_ptr<abstraction::logic::service::IService> getService(const std::string& serviceName) const noexcept;
+				abstraction::data::unique_output_ptr forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept;
+				abstraction::data::unique_output_ptr forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept;
+
+				// one entry per instance, in registration order
+				std::vector<InstanceLoad> getLoad(const std::string& serviceName) const;
+
 			private:
-				BrokerHandler() : m_services{}
-				{					
-					m_services.insert(std::make_pair("tokenizer", std::make_unique<service_system::tokenizer::logic::service::TokenizerService>()));
-				}
-				std::unordered_map<std::string, std::shared_ptr<abstraction::logic::service::IService>> m_services;
+				// the tokenizer gets that many instances
+				explicit BrokerHandler(unsigned tokenizerInstances = 1);
+
+				// owner is null when data is only lent for the call
+				abstraction::data::unique_output_ptr forward(const std::string& serviceName, const abstraction::data::InputData& data,
+					std::shared_ptr<abstraction::data::InputData> owner) const noexcept;
+
+				using LazyService = abstraction::logic::Lazy<std::shared_ptr<abstraction::logic::service::IService>>;
+				struct Instance;
+				struct Group;
+				static Instance& selectInstance(const Group& group, const abstraction::data::InputData& data);
+
+				// immutable once published like the one of BrokerDiscoverer, the load counters live in the instances
+				struct Registry;
+				std::shared_ptr<const Registry> m_registry;
+				std::mutex m_writer;
 
 			private:
 				BrokerHandler(const BrokerHandler&) = delete;
@@ -487,15 +1557,30 @@
 					return instance;
 				}
 				~BrokerDiscoverer() = default;
+				// false for a null service or a name already registered
 				bool registerService(RegisteredServiceType serviceType, std::unique_ptr<abstraction::logic::service::IService> s) noexcept;
+				// names of the services of that type, in registration order
 				std::vector<std::string> getService(RegisteredServiceType serviceType) const;
+				std::shared_ptr<abstraction::logic::service::IService> findService(const std::string& serviceName) const noexcept;
+
 				std::shared_ptr<abstraction::data::OutputData> forward(const std::string& serviceName, const abstraction::data::InputData& data) const noexcept;
+				std::shared_ptr<abstraction::data::OutputData> forward(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const noexcept;
+				// on the broker's shared worker pool, same completion rules as BrokerForwarder::forwardAsync
+				std::future<std::shared_ptr<abstraction::data::OutputData>> forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data) const;
+				void forwardAsync(const std::string& serviceName, std::shared_ptr<abstraction::data::InputData> data, std::function<void(std::shared_ptr<abstraction::data::OutputData>)> done) const;
 
 			private:
-				BrokerDiscoverer() : m_services{}
+				BrokerDiscoverer();
+
+				// immutable once published: registerService copies it, readers never lock
+				struct Registry
 				{
-				}
-				std::vector<std::pair<RegisteredServiceType, std::unique_ptr<abstraction::logic::service::IService>>> m_services;
+					std::unordered_map<std::string, std::shared_ptr<abstraction::logic::service::IService>> byName;
+					std::unordered_map<RegisteredServiceType, std::vector<std::string>> byType;
+				};
+
+				std::shared_ptr<const Registry> m_registry;
+				std::mutex m_writer;
 
 			private:
 				BrokerDiscoverer(const BrokerDiscoverer&) = delete;
@@ -504,6 +1589,70 @@
 				BrokerDiscoverer& operator=(BrokerDiscoverer&&) = delete;
 			};
 		}
+
+#ifdef CLOCK_REMOTE_SERVICES
+		// built only with CLOCK_REMOTE_SERVICES defined, BrokerForwarder then also serves "tokenizer.remote"
+		namespace remote
+		{
+			struct RemoteOptions
+			{
+				size_t ringBytes = 4 << 20;						// shared memory per direction
+				std::chrono::milliseconds startTimeout{ 5000 };	// for the host to connect
+				std::chrono::milliseconds callTimeout{ 2000 };
+			};
+
+			// an IService run by a host process: requests go over a Unix domain socket, their payloads through a
+			// ring in shared memory, and only payloads the ring has no room for through the socket.
+			// A host that exits, crashes or misses the call timeout is terminated, the calls in flight give a null
+			// result and the next call starts a new host
+			class RemoteService : public abstraction::logic::service::IService
+			{
+			public:
+				struct Statistics
+				{
+					size_t calls;
+					size_t failures;		// null results, timeouts included
+					size_t timeouts;
+					size_t starts;			// hosts started
+					size_t sharedBytes;		// payload bytes through the ring, both directions
+					size_t inlineBytes;		// payload bytes through the socket
+					uint64_t nanoseconds;	// round trips of the calls that succeeded
+				};
+
+				// serviceName is built by the host, see runServiceHost; the host starts on the first call
+				RemoteService(const std::string& serviceName, std::shared_ptr<const abstraction::logic::service::IServiceCodec> codec, RemoteOptions options = RemoteOptions{});
+				~RemoteService();
+
+				std::string getName() const override;
+				const std::string getServiceDescription() const override { return "runs a service in a host process"; }
+				const std::string getServiceLocalisation() const override { return "local host process"; }
+
+				abstraction::data::OutputData* transform(std::shared_ptr<abstraction::data::InputData> d) override;
+				abstraction::data::unique_output_ptr transformOwned(std::shared_ptr<abstraction::data::InputData> d) override;
+				// the input is encoded during the call, it is never kept
+				abstraction::data::unique_output_ptr transformBorrowed(const abstraction::data::InputData& d) override;
+
+				Statistics getStatistics() const;
+
+			private:
+				class RemoteServiceImpl;
+				std::unique_ptr<RemoteServiceImpl> pimpl_;
+
+			private:
+				RemoteService(const RemoteService&) = delete;
+				RemoteService(RemoteService&&) = delete;
+				RemoteService& operator=(const RemoteService&) = delete;
+				RemoteService& operator=(RemoteService&&) = delete;
+			};
+
+			// the command line a RemoteService starts its host with begins with this switch
+			extern const wchar_t* const serviceHostSwitch;
+
+			// body of a host process, given the command line after the program name; serves one RemoteService
+			// until it disconnects and returns the exit code
+			int runServiceHost(const std::wstring& commandLine);
+		}
+#endif
 	}
 
 	namespace app
@@ -512,23 +1661,28 @@
 
 		namespace data_abstraction
 		{
-			class UpdateCommand : public abstraction::data::command::Command
+			// sent on every timer tick, pooled so that ticking does not allocate: use UpdateCommand::make
+			class UpdateCommand : public abstraction::data::command::PooledCommand<UpdateCommand>
 			{
 			public:
 				UpdateCommand(const std::string& t)
-					: Command(), 
+					: PooledCommand(), 
 					m_time{ t } {};
 
 				UpdateCommand(const UpdateCommand& dC)
-					:Command(dC),
+					:PooledCommand(dC),
 					m_time{ dC.m_time } {}
 
 				~UpdateCommand() = default;
 
+				// a recycled command keeps the capacity of its string
+				void reset(const std::string& t) { m_time = t; }
+				void reset(const UpdateCommand& dC) { m_time = dC.m_time; }
+
 			protected:
 				virtual void undoImpl()noexcept override;
 				virtual void executeImpl()noexcept override;
-				virtual UpdateCommand* cloneImpl()const noexcept override { return new UpdateCommand{ *this }; }
+				virtual UpdateCommand* cloneImpl()const noexcept override { return acquire(*this); }
 
 				//virtual	void checkPostConditionImpl()const override {};
 				//virtual	void checkPreConditionImpl()const override {};
@@ -641,6 +1795,29 @@
 					float m_fAngle;
 				};
 
+				// every hand of one ModelProxy::update, published as a single event
+				class ModelFrameData : public abstraction::data::OutputData
+				{
+					using Hands = std::vector<ModelOutputData>;
+
+				public:
+					using const_iterator = Hands::const_iterator;
+
+				public:
+					explicit ModelFrameData(size_t count = 0) { m_hands.reserve(count); }
+					~ModelFrameData() = default;
+
+					void add(const Rectangle& r, float angle) { m_hands.emplace_back(r, angle); }
+					void clear() { m_hands.clear(); }
+
+					const_iterator begin() const { return m_hands.cbegin(); }
+					const_iterator end() const { return m_hands.cend(); }
+					size_t size() const { return m_hands.size(); }
+
+				private:
+					Hands m_hands;
+				};
+
 				enum class ShapeID
 				{
 					HOURS,
@@ -711,6 +1888,10 @@
 						using Publisher::subscribe;
 						using Publisher::unsubscribe;
 
+						// typed frame channel, the frame is delivered by reference
+						void subscribe(std::unique_ptr<abstraction::boundary::proxy::channel::Observer<data_abstraction::ModelFrameData>> observer);
+						void unsubscribe(const std::string& observerName);
+
 					public:
 						static ModelProxy& getInstance();
 
@@ -719,9 +1900,15 @@
 						ModelProxy();
 
 					private:
+						EventHandle m_resultAvailable;
+						EventHandle m_adamError;
+
 						data_abstraction::ModelProxyImpl m_data_;
 						using Model = std::map<std::string, data_abstraction::Rectangle>;
 						Model m_data;
+
+						abstraction::boundary::proxy::channel::Publisher<data_abstraction::ModelFrameData> m_frames;
+						data_abstraction::ModelFrameData m_frame;	// reused by every update
 					};
 				}
 
@@ -813,7 +2000,7 @@
 							static const char* InputEntered;
 
 						public:
-							UserInterface() { Publisher::registerEvent(InputEntered); }
+							UserInterface() : m_inputEntered{ Publisher::registerEvent(InputEntered) } {}
 							virtual ~UserInterface() = default;
 							// virtual void sendInput() override;
 							// virtual void sendOutput(const char *) override;
@@ -822,6 +2009,13 @@
 							using Publisher::notify;
 							using Publisher::subscribe;
 							using Publisher::unsubscribe;
+
+							using IUserInteraction::sendOutput;
+							// by default each hand goes through sendOutput(std::shared_ptr<Data>), override it to take the frame at once
+							virtual void sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame);
+
+						protected:
+							EventHandle m_inputEntered;
 						};
 					}
 				}
@@ -840,6 +2034,7 @@
 						static CommandRepository& getInstance();
 
 						void registerCommand(const std::string& name, abstraction::data::command::unique_command_ptr c);
+						abstraction::data::exception::Status tryRegisterCommand(const std::string& name, abstraction::data::command::unique_command_ptr&& c);
 						abstraction::data::command::unique_command_ptr deregisterCommand(const std::string& name);
 						size_t count() const;
 						abstraction::data::command::unique_command_ptr getCommandByName(const std::string& name) const;
@@ -976,6 +2171,15 @@
 						const std::string& getData() const { return uii; }
 						const std::string& getSender() const { return sender_; }
 
+						std::shared_ptr<abstraction::data::InputData> clone() const override { return std::make_shared<UserInterfaceIntputData>(*this); }
+
+						// refills an input no one else holds, the strings keep their capacity
+						void reset(const std::string& userInput, const std::string& Sender)
+						{
+							uii = userInput;
+							sender_ = Sender;
+						}
+
 					private:
 						std::string uii;
 						std::string sender_;
@@ -1028,6 +2232,7 @@
 								void sendInput() override;
 								void sendOutput(const char* msg) override;
 								void sendOutput(std::shared_ptr<abstraction::data::Data>d)override;
+								void sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame)override;
 
 							private:
 								std::istream& m_is;
@@ -1070,17 +2275,24 @@
 								void sendInput() override;
 								void sendOutput(const char* msg) override;
 								void sendOutput(std::shared_ptr<abstraction::data::Data>d)override;
+								void sendOutput(const server_subsystem::data_abstraction::ModelFrameData& frame)override;
 								HWND Window() const { return m_hwnd; }
 
 							private:
 								static LRESULT CALLBACK	WinProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 								HRESULT OnRender(const abstraction::data::Shape&,float angle);
 								HRESULT OnHandRender(const server_subsystem::data_abstraction::Rectangle& rec, float angle);
+								HRESULT OnFrameRender(const server_subsystem::data_abstraction::ModelFrameData& frame);
+								void DrawHand(const server_subsystem::data_abstraction::Rectangle& rec, float angle);
 								void OnResize(UINT width, UINT height);
+								// sends the local time as a "timer" input, reusing the buffers of the last tick
+								void notifyTime();
 
 							private:
 								HWND m_hwnd;
 								data::WinImpl m_data;
+								std::string m_time;
+								std::shared_ptr<data::UserInterfaceIntputData> m_tick;
 
 								//D2D1_RECT_F m_rectangle;
 							};
@@ -1102,6 +2314,20 @@
 
 							controller::control::state_dependent_control::CommandDispatcher& m_ce;
 						};
+
+						class ModelFrameObserver : public abstraction::boundary::proxy::channel::Observer<server_subsystem::data_abstraction::ModelFrameData>
+						{
+						public:
+							explicit ModelFrameObserver(user_interaction::UserInterface& ui)
+								: Observer{ "ModelFrameObserver" },
+								m_ui{ ui }
+							{};
+
+						private:
+							void notifyImpl(const server_subsystem::data_abstraction::ModelFrameData& frame) override { m_ui.sendOutput(frame); }
+
+							user_interaction::UserInterface& m_ui;
+						};
 					} // namespace proxy
 				}
 
@@ -0,0 +1,664 @@
+/*
+	Copyright (C) 2022  Barth.Feudong
+	Author can be contacted here: <https://github.com/mrSchaffman/Cpp-Clock-App>
+
+	This file is part of the Clock project. using the Win32 API and The COM
+
+	Clock is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Clock is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// console benchmarks of the hot paths, built by Bench.vcxproj and never part of the clock itself.
+// Runs every section, or only the ones named on the command line; the exit code is the number of failed checks
+
+#include"app.h"
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdio>
+#include<cstring>
+#include<cwchar>
+#include<thread>
+#include<vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	int failures = 0;
+
+	double secondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// nanoseconds per call of body(), repeated in batches until about 200 ms have passed
+	template<class Body>
+	double measure(Body body, int batch = 64)
+	{
+		size_t calls = 0;
+		const auto start = Clock::now();
+		double seconds;
+		do
+		{
+			for (int i = 0; i < batch; ++i)
+				body();
+			calls += batch;
+			seconds = secondsSince(start);
+		} while (seconds < 0.2);
+		return seconds * 1e9 / calls;
+	}
+
+	double gigabytesPerSecond(size_t bytes, double nanoseconds)
+	{
+		return bytes / nanoseconds;
+	}
+
+	// words of 1 to 12 letters from alphabet, separated by one of separators; the same text on every run
+	std::string makeText(size_t bytes, const char* alphabet, const char* separators)
+	{
+		const auto letters = std::strlen(alphabet);
+		const auto kinds = std::strlen(separators);
+		uint32_t state = 2463534242u;
+		auto next = [&state] {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		};
+
+		std::string text;
+		text.reserve(bytes);
+		while (text.size() < bytes)
+		{
+			for (auto n = 1 + next() % 12; n && text.size() < bytes; --n)
+				text += alphabet[next() % letters];
+			if (text.size() < bytes)
+				text += separators[next() % kinds];
+		}
+		return text;
+	}
+
+	void check(bool ok, const char* what)
+	{
+		if (ok)
+			return;
+		std::printf("  FAILED: %s\n", what);
+		++failures;
+	}
+
+	class CountingObserver : public abstraction::boundary::proxy::Observer
+	{
+	public:
+		CountingObserver(const std::string& name, std::atomic<size_t>& calls) : Observer{ name }, m_calls{ calls } {}
+
+	private:
+		void notifyImpl(std::shared_ptr<abstraction::data::Data>) override { m_calls.fetch_add(1, std::memory_order_relaxed); }
+
+		std::atomic<size_t>& m_calls;
+	};
+
+	// notify from several threads while others keep subscribing and unsubscribing
+	void benchPublisher()
+	{
+		using service_system::publisher::Publisher;
+
+		std::printf("publisher\n");
+		for (auto strategy : { Publisher::PublishingStrategy::Synchronous, Publisher::PublishingStrategy::Concurrent })
+		{
+			std::atomic<size_t> calls{};
+			Publisher publisher{ strategy };
+			const auto event = publisher.registerEvent("tick");
+			for (int i = 0; i < 8; ++i)
+				publisher.subscribe(event, std::make_unique<CountingObserver>("steady" + std::to_string(i), calls));
+
+			std::printf("  %-12s notify, 8 observers      %8.1f ns\n", strategy == Publisher::PublishingStrategy::Synchronous ? "synchronous" : "concurrent",
+				measure([&] { publisher.notify(event, nullptr); }));
+		}
+
+		// the synchronous publisher is single threaded, only the concurrent one takes the stress
+		for (unsigned publishers : { 1u, 2u, 4u })
+		{
+			const unsigned churners = 2;
+			std::atomic<size_t> calls{};
+			std::atomic<size_t> churns{};
+			std::atomic<bool> stop{};
+			Publisher publisher{ Publisher::PublishingStrategy::Concurrent };
+			const auto event = publisher.registerEvent("tick");
+			for (int i = 0; i < 8; ++i)
+				publisher.subscribe(event, std::make_unique<CountingObserver>("steady" + std::to_string(i), calls));
+
+			std::vector<std::thread> threads;
+			for (unsigned c = 0; c < churners; ++c)
+			{
+				threads.emplace_back([&, c] {
+					const auto name = "churn" + std::to_string(c);
+					while (!stop.load(std::memory_order_relaxed))
+					{
+						publisher.subscribe(event, std::make_unique<CountingObserver>(name, calls));
+						publisher.unsubscribe(event, name);
+						churns.fetch_add(1, std::memory_order_relaxed);
+					}
+				});
+			}
+			std::atomic<size_t> notifies{};
+			for (unsigned p = 0; p < publishers; ++p)
+			{
+				threads.emplace_back([&] {
+					while (!stop.load(std::memory_order_relaxed))
+					{
+						publisher.notify(event, nullptr);
+						notifies.fetch_add(1, std::memory_order_relaxed);
+					}
+				});
+			}
+			const auto start = Clock::now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			stop = true;
+			for (auto& t : threads)
+				t.join();
+			const auto seconds = secondsSince(start);
+
+			std::printf("  concurrent   %u publishers, %u churners  %8.0f notify/s  %8.0f churn/s\n", publishers, churners, notifies / seconds, churns / seconds);
+			check(calls >= 8 * notifies, "every notify reaches the steady observers");
+		}
+	}
+
+	struct Frame : public abstraction::data::Data
+	{
+		int seconds = 0;
+	};
+
+	// what the views did before the typed channels: recover the event type from the shared_ptr
+	class CastingObserver : public abstraction::boundary::proxy::Observer
+	{
+	public:
+		CastingObserver(const std::string& name, long& sum) : Observer{ name }, m_sum{ sum } {}
+
+	private:
+		void notifyImpl(std::shared_ptr<abstraction::data::Data> d) override
+		{
+			if (auto frame = std::dynamic_pointer_cast<Frame>(d))
+				m_sum += frame->seconds;
+		}
+
+		long& m_sum;
+	};
+
+	class FrameObserver : public abstraction::boundary::proxy::channel::Observer<Frame>
+	{
+	public:
+		FrameObserver(const std::string& name, long& sum) : Observer{ name }, m_sum{ sum } {}
+
+	private:
+		void notifyImpl(const Frame& frame) override { m_sum += frame.seconds; }
+
+		long& m_sum;
+	};
+
+	// the same frame to 8 views, through the Data path and through a typed channel
+	void benchChannel()
+	{
+		std::printf("channel\n");
+
+		long sum = 0;
+		service_system::publisher::Publisher publisher;
+		const auto event = publisher.registerEvent("frame");
+		abstraction::boundary::proxy::channel::Publisher<Frame> channel;
+		for (int i = 0; i < 8; ++i)
+		{
+			publisher.subscribe(event, std::make_unique<CastingObserver>("view" + std::to_string(i), sum));
+			channel.subscribe(std::make_unique<FrameObserver>("view" + std::to_string(i), sum));
+		}
+
+		auto frame = std::make_shared<Frame>();
+		frame->seconds = 1;
+		std::printf("  shared_ptr<Data> + dynamic_pointer_cast  %8.1f ns\n", measure([&] { publisher.notify(event, frame); }));
+		std::printf("  channel::Publisher<Frame>                %8.1f ns\n", measure([&] { channel.notify(*frame); }));
+
+		sum = 0;
+		publisher.notify(event, frame);
+		channel.notify(*frame);
+		check(sum == 16, "both paths reach every view");
+	}
+
+	// one notify to 1 .. 100k observers, and the cost of building that list one subscribe at a time
+	void benchFanOut()
+	{
+		using service_system::publisher::Publisher;
+
+		std::printf("fan-out\n");
+		for (auto strategy : { Publisher::PublishingStrategy::Synchronous, Publisher::PublishingStrategy::Concurrent })
+		{
+			const char* name = strategy == Publisher::PublishingStrategy::Synchronous ? "synchronous" : "concurrent";
+			for (size_t observers : { 1, 10, 1000, 100000 })
+			{
+				std::atomic<size_t> calls{};
+				Publisher publisher{ strategy };
+				const auto event = publisher.registerEvent("tick");
+
+				auto start = Clock::now();
+				for (size_t i = 0; i < observers; ++i)
+					publisher.subscribe(event, std::make_unique<CountingObserver>(std::to_string(i), calls));
+				const auto subscribe = secondsSince(start) * 1e9 / observers;
+
+				const auto notify = measure([&] { publisher.notify(event, nullptr); });
+				std::printf("  %-12s %6zu observers  subscribe %8.1f ns  notify %10.1f ns  %6.2f ns/observer\n", name, observers, subscribe, notify, notify / observers);
+
+				calls = 0;
+				publisher.notify(event, nullptr);
+				check(calls == observers, "notify reaches every observer once");
+			}
+		}
+
+		// the batch subscribe makes one copy of the list for all of them
+		std::atomic<size_t> calls{};
+		Publisher publisher{ Publisher::PublishingStrategy::Concurrent };
+		const auto event = publisher.registerEvent("tick");
+		std::vector<std::unique_ptr<abstraction::boundary::proxy::Observer>> batch;
+		for (size_t i = 0; i < 100000; ++i)
+			batch.push_back(std::make_unique<CountingObserver>(std::to_string(i), calls));
+		const auto start = Clock::now();
+		publisher.subscribeMany(event, std::move(batch));
+		std::printf("  concurrent   subscribeMany 100000     %8.1f ns/observer\n", secondsSince(start) * 1e9 / 100000);
+	}
+
+	// the same failures reported by exception and by status
+	void benchErrorPaths()
+	{
+		using service_system::publisher::Publisher;
+		using abstraction::data::exception::Exception;
+
+		std::printf("error paths\n");
+		std::atomic<size_t> calls{};
+		Publisher publisher;
+		const auto event = publisher.registerEvent("tick");
+		const auto unknown = static_cast<Publisher::EventHandle>(1000);
+		publisher.subscribe(event, std::make_unique<CountingObserver>("taken", calls));
+
+		const auto subscribeThrow = measure([&] {
+			try { publisher.subscribe(event, std::make_unique<CountingObserver>("taken", calls)); }
+			catch (const Exception&) {}
+		});
+		const auto subscribeStatus = measure([&] {
+			std::unique_ptr<abstraction::boundary::proxy::Observer> observer = std::make_unique<CountingObserver>("taken", calls);
+			publisher.trySubscribe(event, std::move(observer));
+		});
+		std::printf("  duplicate subscribe    throw %8.1f ns  status %8.1f ns\n", subscribeThrow, subscribeStatus);
+
+		const auto unsubscribeThrow = measure([&] {
+			try { publisher.unsubscribe(event, "missing"); }
+			catch (const Exception&) {}
+		});
+		const auto unsubscribeStatus = measure([&] { publisher.tryUnsubscribe(event, "missing"); });
+		const auto unsubscribeMessage = measure([&] { publisher.tryUnsubscribe(event, "missing").message("missing"); });
+		std::printf("  unknown unsubscribe    throw %8.1f ns  status %8.1f ns  status + message %8.1f ns\n", unsubscribeThrow, unsubscribeStatus, unsubscribeMessage);
+
+		const auto notifyThrow = measure([&] {
+			try { publisher.notify(unknown, nullptr); }
+			catch (const Exception&) {}
+		});
+		const auto notifyStatus = measure([&] { publisher.tryNotify(unknown, nullptr); });
+		std::printf("  unknown event notify   throw %8.1f ns  status %8.1f ns\n", notifyThrow, notifyStatus);
+
+		check(!publisher.tryUnsubscribe(event, "missing") && !publisher.tryNotify(unknown, nullptr), "the failures are reported");
+	}
+
+	// one multi-megabyte payload as owned strings, as spans into the caller's buffer and into a reused arena
+	void benchViews()
+	{
+		namespace tokenizer = service_system::tokenizer;
+
+		std::printf("views\n");
+		tokenizer::logic::service::TokenizerService service;
+		for (size_t bytes : { 4 << 10, 4 << 20 })
+		{
+			const auto text = makeText(bytes, "abcdefghijklmnopqrstuvwxyz", " ");
+			const int batch = bytes < (1 << 20) ? 64 : 1;
+
+			size_t owned = 0;
+			const tokenizer::data::TokenizerInputData input{ text, ' ', tokenizer::data::CaseTransform::None };
+			const auto strings = measure([&] {
+				auto out = service.transformBorrowed(input);
+				owned = static_cast<const tokenizer::data::TokenizerOutputData&>(*out).size();
+			}, batch);
+
+			size_t viewed = 0;
+			const tokenizer::data::TokenizerViewInputData view{ text.data(), text.size(), ' ' };
+			const auto spans = measure([&] {
+				auto out = service.transformBorrowed(view);
+				viewed = static_cast<const tokenizer::data::TokenizerSpanOutputData&>(*out).size();
+			}, batch);
+
+			tokenizer::data::TokenArena arena;
+			const auto arenaTime = measure([&] { service.tokenize(text.data(), text.size(), ' ', tokenizer::data::CaseTransform::None, arena); }, batch);
+
+			std::printf("  %8zu bytes  strings %6.2f GB/s  spans %6.2f GB/s  arena %6.2f GB/s\n", bytes,
+				gigabytesPerSecond(bytes, strings), gigabytesPerSecond(bytes, spans), gigabytesPerSecond(bytes, arenaTime));
+			check(owned == viewed && viewed == arena.size(), "every path finds the same tokens");
+		}
+	}
+
+	const char* levelName(service_system::tokenizer::logic::business::SimdLevel level)
+	{
+		using service_system::tokenizer::logic::business::SimdLevel;
+		return level == SimdLevel::AVX2 ? "avx2" : level == SimdLevel::SSE2 ? "sse2" : "scalar";
+	}
+
+	bool sameSpans(const std::vector<service_system::tokenizer::data::TokenSpan>& a, const std::vector<service_system::tokenizer::data::TokenSpan>& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const auto& x, const auto& y) {
+			return x.offset == y.offset && x.length == y.length; });
+	}
+
+	// every kernel against the scalar one around the 16 and 32 byte block edges, then their throughput
+	void benchSimd()
+	{
+		namespace business = service_system::tokenizer::logic::business;
+		using business::SimdLevel;
+
+		std::printf("simd, this cpu runs %s\n", levelName(business::getSimdLevel()));
+		const SimdLevel levels[] = { SimdLevel::SSE2, SimdLevel::AVX2 };
+
+		// the block edges, with a token or a run of separators across each, and bytes toupper must leave alone
+		const std::string bodies[] =
+		{
+			makeText(256, "abcdefghijklmnopqrstuvwxyz", " "),
+			makeText(256, "aB", " \t\n,"),
+			makeText(256, "a\x80z\xff{`", " ,"),
+			std::string(256, ' '),
+			std::string(256, 'x'),
+		};
+		const size_t lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 255 };
+		const char delimiters[] = { ' ', ',', '\0' };
+
+		size_t cases = 0;
+		size_t mismatches = 0;
+		for (const auto& body : bodies)
+		{
+			for (auto length : lengths)
+			{
+				// as is, then ending on separators
+				for (const auto& tail : { std::string{}, std::string(", \t"), std::string(40, ' ') })
+				{
+					// every alignment of the first byte inside a block
+					for (size_t shift = 0; shift < 4; ++shift)
+					{
+						std::string buffer(shift, '#');
+						buffer += body.substr(0, length) + tail;
+						const char* first = buffer.data() + shift;
+						const size_t size = buffer.size() - shift;
+
+						for (auto delimiter : delimiters)
+						{
+							std::vector<service_system::tokenizer::data::TokenSpan> expected;
+							business::tokenize(first, size, delimiter, expected, SimdLevel::Scalar);
+							for (auto level : levels)
+							{
+								std::vector<service_system::tokenizer::data::TokenSpan> spans;
+								business::tokenize(first, size, delimiter, spans, level);
+								++cases;
+								if (!sameSpans(expected, spans))
+								{
+									++mismatches;
+									std::printf("  %s tokenize differs: length %zu, tail %zu, shift %zu, delimiter %d\n", levelName(level), length, tail.size(), shift, delimiter);
+								}
+							}
+						}
+
+						std::string expected{ first, size };
+						business::toUpper(&expected[0], expected.size(), SimdLevel::Scalar);
+						for (auto level : levels)
+						{
+							std::string upper{ first, size };
+							business::toUpper(&upper[0], upper.size(), level);
+							++cases;
+							if (upper != expected)
+							{
+								++mismatches;
+								std::printf("  %s toUpper differs: length %zu, tail %zu, shift %zu\n", levelName(level), length, tail.size(), shift);
+							}
+						}
+					}
+				}
+			}
+		}
+		std::printf("  %zu comparisons with the scalar kernels, %zu mismatches\n", cases, mismatches);
+		check(mismatches == 0, "every simd level matches the scalar kernels");
+
+		const SimdLevel all[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+		for (size_t bytes : { 64, 4 << 10, 4 << 20 })
+		{
+			auto text = makeText(bytes, "abcdefghijklmnopqrstuvwxyz", " ");
+			const int batch = bytes < (1 << 20) ? 64 : 1;
+			std::vector<service_system::tokenizer::data::TokenSpan> spans;
+			std::printf("  %8zu bytes", bytes);
+			for (auto level : all)
+			{
+				const auto scan = measure([&] {
+					spans.clear();
+					business::tokenize(text.data(), text.size(), ' ', spans, level);
+				}, batch);
+				const auto upper = measure([&] { business::toUpper(&text[0], text.size(), level); }, batch);
+				std::printf("  %s %6.2f / %6.2f GB/s", levelName(level), gigabytesPerSecond(bytes, scan), gigabytesPerSecond(bytes, upper));
+			}
+			std::printf("  (tokenize / toUpper)\n");
+		}
+	}
+
+	// the same 16 MB over more and more workers, against the single threaded pass
+	void benchParallel()
+	{
+		namespace business = service_system::tokenizer::logic::business;
+
+		std::printf("parallel, %u cores\n", std::thread::hardware_concurrency());
+		const auto text = makeText(16 << 20, "abcdefghijklmnopqrstuvwxyz", " \t\n");
+		std::vector<service_system::tokenizer::data::TokenSpan> expected;
+		business::tokenize(text.data(), text.size(), ' ', expected);
+
+		std::vector<service_system::tokenizer::data::TokenSpan> spans;
+		spans.reserve(expected.size());
+		const auto single = measure([&] {
+			spans.clear();
+			business::tokenize(text.data(), text.size(), ' ', spans);
+		}, 1);
+		std::printf("  tokenize            %6.2f GB/s\n", gigabytesPerSecond(text.size(), single));
+
+		for (unsigned threads : { 1u, 2u, 4u, 8u, 16u })
+		{
+			const auto parallel = measure([&] {
+				spans.clear();
+				business::tokenizeParallel(text.data(), text.size(), ' ', spans, threads);
+			}, 1);
+			std::printf("  %2u threads          %6.2f GB/s  x%.2f\n", threads, gigabytesPerSecond(text.size(), parallel), single / parallel);
+			check(sameSpans(expected, spans), "the parallel spans match the single threaded ones");
+		}
+	}
+
+	// what the broker adds to a short tokenizer call, and what batching and the result cache save
+	void benchForward()
+	{
+		namespace tokenizer = service_system::tokenizer;
+		using broker_system::white_page::BrokerForwarder;
+
+		std::printf("forward\n");
+		auto& forwarder = BrokerForwarder::getInstance();
+		const auto handle = forwarder.resolve("tokenizer");
+		tokenizer::logic::service::TokenizerService direct;
+		auto input = std::make_shared<tokenizer::data::TokenizerInputData>("the quick brown fox jumps over the lazy dog", ' ', tokenizer::data::CaseTransform::None);
+
+		std::printf("  transformBorrowed, no broker      %8.1f ns\n", measure([&] { direct.transformBorrowed(*input); }));
+		std::printf("  forward by name, borrowed         %8.1f ns\n", measure([&] { forwarder.forward("tokenizer", *input); }));
+		std::printf("  forward by handle, borrowed       %8.1f ns\n", measure([&] { forwarder.forward(handle, *input); }));
+		std::printf("  forward by handle, shared         %8.1f ns\n", measure([&] { forwarder.forward(handle, input); }));
+
+		const abstraction::data::InputBatch batch(64, input);
+		std::printf("  forwardBatch of 64, per input     %8.1f ns\n", measure([&] { forwarder.forwardBatch(handle, batch); }, 1) / batch.size());
+
+		forwarder.setCacheBudget(1 << 20);
+		forwarder.forwardCached(handle, *input);
+		std::printf("  forwardCached, hit                %8.1f ns\n", measure([&] { forwarder.forwardCached(handle, *input); }));
+		const auto hits = forwarder.getCacheStatistics().hits;
+		forwarder.setCacheBudget(0);
+
+		auto out = forwarder.forward(handle, *input);
+		check(out && static_cast<const tokenizer::data::TokenizerOutputData&>(*out).size() == 9, "the forwarded call tokenizes");
+		check(hits > 0, "the cached calls hit");
+	}
+
+	// 4 threads keep the pool busy, each with up to 16 callback requests in flight; latency is from the call to the callback
+	void benchAsync()
+	{
+		namespace tokenizer = service_system::tokenizer;
+		using broker_system::white_page::BrokerForwarder;
+
+		std::printf("async\n");
+		auto& forwarder = BrokerForwarder::getInstance();
+		const auto handle = forwarder.resolve("tokenizer");
+		auto input = std::make_shared<tokenizer::data::TokenizerInputData>(makeText(4 << 10, "abcdefghijklmnopqrstuvwxyz", " "), ' ');
+
+		for (unsigned workers : { 1u, 2u, 4u })
+		{
+			forwarder.setWorkerThreads(workers);
+
+			const size_t senders = 4;
+			const size_t window = 16;
+			const size_t requests = 20000;
+			std::vector<double> latencies(requests);
+			std::atomic<size_t> failed{};
+
+			const auto start = Clock::now();
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < senders; ++t)
+			{
+				threads.emplace_back([&, t] {
+					std::mutex mutex;
+					std::condition_variable finished;
+					size_t inFlight = 0;
+					for (size_t i = t; i < requests; i += senders)
+					{
+						{
+							std::unique_lock<std::mutex> lock{ mutex };
+							finished.wait(lock, [&] { return inFlight < window; });
+							++inFlight;
+						}
+						const auto sent = Clock::now();
+						forwarder.forwardAsync(handle, input, [&, i, sent](abstraction::data::unique_output_ptr out) {
+							latencies[i] = secondsSince(sent) * 1e6;
+							if (!out)
+								++failed;
+							std::lock_guard<std::mutex> lock{ mutex };
+							--inFlight;
+							finished.notify_one();
+						});
+					}
+					std::unique_lock<std::mutex> lock{ mutex };
+					finished.wait(lock, [&] { return inFlight == 0; });
+				});
+			}
+			for (auto& t : threads)
+				t.join();
+			const auto seconds = secondsSince(start);
+
+			std::sort(latencies.begin(), latencies.end());
+			std::printf("  %u workers  %8.0f requests/s  p50 %8.1f us  p99 %8.1f us\n", workers, requests / seconds,
+				latencies[requests / 2], latencies[requests * 99 / 100]);
+			check(failed == 0, "every async request gets a result");
+		}
+		forwarder.setWorkerThreads(0);
+	}
+
+#ifdef CLOCK_REMOTE_SERVICES
+	// round trips to a tokenizer host process next to the same calls in process
+	void benchRemote()
+	{
+		namespace tokenizer = service_system::tokenizer;
+		using broker_system::white_page::BrokerForwarder;
+
+		std::printf("remote\n");
+		auto& forwarder = BrokerForwarder::getInstance();
+		const auto local = forwarder.resolve("tokenizer");
+		const auto remote = forwarder.resolve("tokenizer.remote");
+		check(static_cast<bool>(remote), "the remote tokenizer resolves");
+		if (!remote)
+			return;
+
+		for (size_t bytes : { 64, 64 << 10, 1 << 20 })
+		{
+			const tokenizer::data::TokenizerInputData input{ makeText(bytes, "abcdefghijklmnopqrstuvwxyz", " "), ' ' };
+			const int batch = bytes < (64 << 10) ? 64 : 1;
+
+			// the first call starts the host
+			auto out = forwarder.forward(remote, input);
+			auto expected = forwarder.forward(local, input);
+			check(out && expected && static_cast<const tokenizer::data::TokenizerOutputData&>(*out).size() == static_cast<const tokenizer::data::TokenizerOutputData&>(*expected).size(),
+				"the host gives the in-process result");
+
+			const auto inProcess = measure([&] { forwarder.forward(local, input); }, batch);
+			const auto hosted = measure([&] { forwarder.forward(remote, input); }, batch);
+			std::printf("  %8zu bytes  in process %10.1f us  host process %10.1f us\n", bytes, inProcess / 1000, hosted / 1000);
+		}
+	}
+#endif
+
+	struct Section
+	{
+		const char* name;
+		void(*run)();
+	};
+
+	const Section sections[] =
+	{
+		{ "publisher", benchPublisher },
+		{ "channel", benchChannel },
+		{ "fan-out", benchFanOut },
+		{ "errors", benchErrorPaths },
+		{ "views", benchViews },
+		{ "simd", benchSimd },
+		{ "parallel", benchParallel },
+		{ "forward", benchForward },
+		{ "async", benchAsync },
+#ifdef CLOCK_REMOTE_SERVICES
+		{ "remote", benchRemote },
+#endif
+	};
+}
+
+int main(int argc, char** argv)
+{
+#ifdef CLOCK_REMOTE_SERVICES
+	// the remote tokenizer starts this program again as its host, see wWinMain
+	std::wstring commandLine;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i > 1)
+			commandLine += L' ';
+		for (const char* c = argv[i]; *c; ++c)
+			commandLine += static_cast<wchar_t>(static_cast<unsigned char>(*c));
+	}
+	if (commandLine.compare(0, wcslen(broker_system::remote::serviceHostSwitch), broker_system::remote::serviceHostSwitch) == 0)
+		return broker_system::remote::runServiceHost(commandLine);
+#endif
+
+	for (const auto& section : sections)
+	{
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i)
+			selected = selected || std::strcmp(argv[i], section.name) == 0;
+		if (selected)
+			section.run();
+	}
+	return failures;
+}
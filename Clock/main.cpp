@@ -31,6 +31,13 @@ using namespace app;
  {
 	 HeapSetInformation(NULL, HeapEnableTerminationOnCorruption, NULL, 0);
 
+#ifdef CLOCK_REMOTE_SERVICES
+	 // started by a RemoteService to run one of its services, without any window
+	 const std::wstring commandLine{ pCmdLine };
+	 if (commandLine.compare(0, wcslen(broker_system::remote::serviceHostSwitch), broker_system::remote::serviceHostSwitch) == 0)
+		 return broker_system::remote::runServiceHost(commandLine);
+#endif
+
 	 Facade facade;
 	 facade.run();
 